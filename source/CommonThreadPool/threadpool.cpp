@@ -2,44 +2,44 @@
 
 const int TASK_MAX_THRESHHOLD = INT32_MAX;
 const int THREAD_MAX_THRESHHOLD = 1024;
-const int THREAD_MAX_IDLE_TIME = 60; // λs
+const int THREAD_MAX_IDLE_TIME = 60; // 单位s
 
 ThreadPool::ThreadPool(): initThreadSize_(0), taskSize_(0), curThreadSize_(0), idleThreadSize_(0), threadSizeThreshHold_(THREAD_MAX_THRESHHOLD), taskQueMaxThreshHold_(TASK_MAX_THRESHHOLD), poolMode_(ThreadPoolMode::MODE_FIXED), isPoolRunning_(false)
 {
 
 }
 
-// ̳߳
+// 开启线程池
 void ThreadPool::start(int initThreadSize)
 {
-	// ̳߳ص״̬
+	// 设置线程池的启动状态
 	isPoolRunning_ = true;
 
-	// ¼ʼ̸߳
+	// 记录初始线程个数
 	initThreadSize_ = initThreadSize;
 	curThreadSize_ = initThreadSize;
 
-	// ̶߳
+	// 创建线程对象
 	for (int i = 0; i < initThreadSize_; i++)
 	{
-		// thread̶߳ʱ̺߳thread̶߳
-		//threads_.emplace_back(new Thread(std::bind(&ThreadPool::threadFunc, this))); // ֱʹָҪֶɾ ڴй© ʹָԶ
+		// 创建thread线程对象时，把线程函数给到thread线程对象
+		//threads_.emplace_back(new Thread(std::bind(&ThreadPool::threadFunc, this))); // 直接使用指针需要手动删除 避免内存泄漏 使用智能指针可以自动析构
 		std::unique_ptr<Thread> uptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1)); 
 		int threadId = uptr->getThreadId();
 		threads_.emplace(threadId, std::move(uptr));
-		//threads_.emplace_back(std::move(uptr)); // unique_ptrʹֵ죬ֵ 
+		//threads_.emplace_back(std::move(uptr)); // unique_ptr不允许使用左值拷贝构造，但允许右值拷贝构造 
 	}
 
-	// ߳	std::vector<Thread*> threads_;
+	// 启动所有线程	std::vector<Thread*> threads_;
 	for (int i = 0; i < initThreadSize_; i++)
 	{
 		threads_[i]->start();
-		idleThreadSize_++; // ¼ʼ̵߳
+		idleThreadSize_++; // 记录初始空闲线程的数量
 	}
 
 }
 
-// ̳߳ģʽ
+// 设置线程池模式
 void ThreadPool::setMode(ThreadPoolMode mode)
 {
 	if (checkRunningState())
@@ -49,13 +49,13 @@ void ThreadPool::setMode(ThreadPoolMode mode)
 	poolMode_ = mode;
 }
 
-//// óʼ߳
+//// 设置初始的线程数量
 //void ThreadPool::setinitThreadSize(int size)
 //{
 //	initThreadSize_ = size;
 //}
 
-// taskֵ
+// 设置task队列上限阈值
 void ThreadPool::setTaskQueMaxThreshHold(int threshhold)
 {
 	if (checkRunningState())
@@ -65,7 +65,7 @@ void ThreadPool::setTaskQueMaxThreshHold(int threshhold)
 	taskQueMaxThreshHold_ = threshhold;
 }
 
-// ̳߳cachedģʽֵ߳
+// 设置线程池cached模式下线程阈值
 void ThreadPool::setThreadSizeMaxThreshHold(int threadthreshhold)
 {
 	if (checkRunningState())
@@ -78,14 +78,14 @@ void ThreadPool::setThreadSizeMaxThreshHold(int threadthreshhold)
 	}
 }
 
-// ̳߳ύ		ûøýӿڣ
+// 给线程池提交任务		用户调用该接口，传入任务对象，生成任务
 Result ThreadPool::submitTask(std::shared_ptr<Task> sp)
 {
-	// ȡ
+	// 获取锁
 	std::unique_lock<std::mutex> lock(taskQueMtx_);
 
-	// ̵߳ͨ ȴ
-	// ûύ1sжύʧܣ
+	// 线程的通信 等待
+	// 用户提交任务，最长不能阻塞超过1s，否则判断提交任务失败，返回
 	/*while (taskQue_.size() == taskQueMaxThreshHold_)
 	{
 		notFull_.wait(lock);
@@ -93,89 +93,89 @@ Result ThreadPool::submitTask(std::shared_ptr<Task> sp)
 	if (!notFull_.wait_for(lock, std::chrono::seconds(1), [&]()->bool {
 		return taskQue_.size() < (size_t)taskQueMaxThreshHold_;}))
 	{
-		// ʾnotFull_ȴ1sȻû
+		// 表示notFull_等待1s，条件依然没有满足
 		std::cerr << "task queue is full, submit task fail." << std::endl;
-		//return task->getResult(); // Task Result	ִ߳tasktaskͱ
+		//return task->getResult(); // Task Result	线程执行完task，task对象就被析构掉了
 		return Result(sp, false);
 	}
 
-	// п࣬
+	// 如果有空余，把任务放入任务队列中
 	taskQue_.emplace(sp);
 	taskSize_++;
 
-	// Ϊ·п϶գnotEmpty_Ͻ֪ͨϿִ߳
+	// 因为新放了任务，任务队列肯定不空，在notEmpty_上进行通知，赶快分配线程执行任务
 	notEmpty_.notify_all();
 
-	// cachedģʽ ȽϽ С ҪͿ߳жǷҪµ̳߳
+	// cached模式 任务处理比较紧急 场景：小而块的任务 需要根据任务数量和空闲线程数量，判断是否需要创建新的线程出来
 	if (poolMode_ == ThreadPoolMode::MODE_CACHED && taskSize_ > idleThreadSize_ && curThreadSize_ < threadSizeThreshHold_)
 	{
 		std::cout << ">>> create new thread!!!" << std::endl;
-		// µ̶߳
-		auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1)); // placeholders ռλ
+		// 创建新的线程对象
+		auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1)); // placeholders 参数占位符
 		//threads_.emplace_back(std::move(ptr));
 		int threadId = ptr->getThreadId();
 		threads_.emplace(threadId, std::move(ptr));
 
-		// ߳
+		// 启动线程
 		threads_[threadId]->start();
-		// ޸̸߳صı
+		// 修改线程个数相关的变量
 		curThreadSize_++;
 		idleThreadSize_++;
 	}
 
-	// Result
+	// 返回任务的Result对象
 	//return task->getResult(); // Task Result 
 	return Result(sp);
 
 }
 
-// ̺߳		̳߳ص̴߳
-// ̺߳أӦ߳Ҳͽ
+// 定义线程函数		线程池的所有线程从任务队列里面消费任务
+// 线程函数返回，相应的线程也就结束了
 void ThreadPool::threadFunc(int threadid)
 {
 	auto lastTime = std::chrono::high_resolution_clock().now(); 
 
 	//while(isPoolRunning_)
-	// ִɣ̳߳زſԻ߳Դ
+	// 所有任务必须执行完成，线程池才可以回收线程资源
 	for(;;)
 	{
 		std::shared_ptr<Task> task;
 		{
-			// ȡ
+			// 获取锁
 			std::unique_lock<std::mutex> lock(taskQueMtx_);
 
-			std::cout << "tid: " << std::this_thread::get_id() << "Իȡ..." << std::endl;
+			std::cout << "tid: " << std::this_thread::get_id() << "尝试获取任务..." << std::endl;
 
-			// cachedģʽ£пѾ˺̣ܶ߳ǿʱ䳬60s߳̽
-			// initThreadSize_߳Ҫл
-			// ǰʱ - һִ߳еʱ > 60s
+			// cached模式下，有可能已经创建了很多的线程，但是空闲时间超过60s，多余线程结束回收
+			// 超过initThreadSize_数量的线程要进行回收
+			// 当前时间 - 上一次线程执行的时间 > 60s
 			
-			// ÿһзһ ֣ʱ  ִз
-			//  + ˫ж 
+			// 每一秒中返回一次 如何区分：超时返回 与 有任务待执行返回
+			// 锁 + 双重判断 
 			while (taskQue_.size() == 0)
 			{
-				// ̳߳Ҫ߳Դ   1.poolֳȻȡ  2.̳߳߳Ȼȡ
+				// 线程池要结束，回收线程资源  死锁问题解决 1.pool现成先获取锁  2.线程池里面的线程先获取锁导致
 				if (!isPoolRunning_)
 				{
 					threads_.erase(threadid);
 					std::cout << "threadid: " << std::this_thread::get_id() << " exit!" << std::endl;
 					exitCond_.notify_all();
-					return; // ̺߳߳̽
+					return; // 线程函数结束，线程结束
 				}
 
 				if (poolMode_ == ThreadPoolMode::MODE_CACHED)
 				{
-					// ʱ
+					// 条件变量超时返回
 					if (std::cv_status::timeout == notEmpty_.wait_for(lock, std::chrono::seconds(1)))
 					{
 						auto nowTime = std::chrono::high_resolution_clock().now();
 						auto during = std::chrono::duration_cast<std::chrono::seconds>(nowTime - lastTime);
-						if (during.count() >= THREAD_MAX_IDLE_TIME && curThreadSize_ > initThreadSize_) // 򽫻߳
+						if (during.count() >= THREAD_MAX_IDLE_TIME && curThreadSize_ > initThreadSize_) // 否则将回收所有线程
 						{
-							// ʼ߳
-							// ¼߳رֵ޸
-							// ̶߳߳бɾ		ûа취ȷ threadFunc = thread
-							// threadId => thread => ɾ
+							// 开始回收线程
+							// 记录线程数量的相关变量的值修改
+							// 把线程对象线程列表容器中删除		没有办法确定 threadFunc 《=》 thread对象
+							// threadId => thread对象 => 删除
 							threads_.erase(threadid);
 							curThreadSize_--;
 							idleThreadSize_--;
@@ -187,21 +187,21 @@ void ThreadPool::threadFunc(int threadid)
 				}
 				else
 				{
-					// ȴnotEmpty_
-					notEmpty_.wait(lock); // [&]()->bool { return taskQue_.size() > 0; } lambdaʽж
+					// 等待notEmpty_
+					notEmpty_.wait(lock); // [&]()->bool { return taskQue_.size() > 0; } 将lambda表达式领出来判断
 				}
 
-				//  ̳߳Ҫ߳Դ
+				// 阻塞 线程池要结束，回收线程资源
 				//if (!isPoolRunning_)
 				//{
 				//	threads_.erase(threadid);
 				//	std::cout << "threadid: " << std::this_thread::get_id() << " exit!" << std::endl;
 				//	exitCond_.notify_all();
-				//	return; // ̺߳ǽǰ߳ˣ
+				//	return; // 结束线程函数，就是结束当前线程了！
 				//}
 			}
 		
-			//// ̳߳Ҫ߳Դ   1.poolֳȻȡ  2.̳߳߳Ȼȡ
+			//// 线程池要结束，回收线程资源  死锁问题解决 1.pool现成先获取锁  2.线程池里面的线程先获取锁导致
 			//if (!isPoolRunning_)
 			//{
 			//	break;
@@ -209,34 +209,34 @@ void ThreadPool::threadFunc(int threadid)
 
 			idleThreadSize_--;
 
-			std::cout << "tid: " << std::this_thread::get_id() << "Իȡɹ..." << std::endl;
+			std::cout << "tid: " << std::this_thread::get_id() << "尝试获取任务成功..." << std::endl;
 
-			// ȡһ
+			// 从任务队列中取出一个任务
 			task = taskQue_.front();
 			taskQue_.pop();
 			taskSize_--;
 
-			// Ȼʣ񣬼ִ֪ͨ߳
+			// 如果依然有剩余任务，继续通知其他线程执行任务
 			if (taskQue_.size() > 0)
 			{
 				notEmpty_.notify_all();
 			}
 
-			// ȡ󣬽֪ͨԼύ
+			// 任务取出后，进行通知，可以继续提交生成任务
 			notFull_.notify_all();
-		} // ͷŵ
+		} // 把锁释放掉
 		
-		// ǰ̸ָ߳
+		// 当前线程负责指向这个任务
 		if (task != nullptr)
 		{
-			//task->run(); // ִ񣬰ķֵsetValResult
+			//task->run(); // 执行任务，把任务的返回值setVal方法给到Result
 			task->exec();
 		}
 		idleThreadSize_++;
-		lastTime = std::chrono::high_resolution_clock().now(); // ִ߳ʱ
+		lastTime = std::chrono::high_resolution_clock().now(); // 更新线程执行完任务时间
 	}
 
-	//// ִ߳ʱ߳̽
+	//// 线程正在执行任务时，线程结束了
 	//threads_.erase(threadid);
 	//std::cout << "threadid: " << std::this_thread::get_id() << " exit!" << std::endl;
 	//exitCond_.notify_all();
@@ -252,7 +252,7 @@ ThreadPool::~ThreadPool()
 	isPoolRunning_ = false;
 	//notEmpty_.notify_all();
 
-	// ȴ̷̳߳߳ ״̬ & ִ
+	// 等待线程池里面所有线程返回 有两种状态：阻塞 & 执行任务中
 	std::unique_lock<std::mutex> lock(taskQueMtx_);	
 	notEmpty_.notify_all();
 	exitCond_.wait(lock, [&]()->bool { return threads_.size() == 0; });
@@ -260,7 +260,7 @@ ThreadPool::~ThreadPool()
 
 
 
-//---------------------------̷߳ʵ-------------------
+//---------------------------线程方法实现-------------------
 int Thread::generateId_ = 0;
 
 Thread::Thread(ThreadFunc func): func_(func), threadId_(generateId_++)
@@ -268,12 +268,12 @@ Thread::Thread(ThreadFunc func): func_(func), threadId_(generateId_++)
 
 }
 
-// ߳
+// 启动线程
 void Thread::start()
 {
-	// һִ߳һ̺߳
-	std::thread t(func_, threadId_); // C++11 ̶߳t  ̺߳func_
-	// ÷߳ pthread_detach
+	// 创建一个线程来执行一个线程函数
+	std::thread t(func_, threadId_); // C++11 线程对象t 和 线程函数func_
+	// 设置分离线程 pthread_detach
 	t.detach();
 }
 
@@ -289,20 +289,51 @@ Thread::~Thread()
 }
 
 
-//---------------------------Resultʵ-------------------
-Result::Result(std::shared_ptr<Task> task, bool isValid): task_(task), isValid_(isValid)
+//---------------------------Result方法实现-------------------
+Result::Result(std::shared_ptr<Task> task, bool isValid): task_(task), isValid_(isValid), isReady_(!isValid)
 {
 	task_->setResult(this);
 }
 
 void Result::setVal(Any any)
 {
-	// 洢Taskֵ
+	// 存储Task返回值
 	this->any_ = std::move(any);
-	sem_.post(); // Ѿȡ񷵻ֵźԴ
+
+	std::vector<std::function<void()>> callbacks;
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		isReady_ = true;
+		callbacks.swap(callbacks_);
+	}
+	sem_.post(); // 已经获取的任务返回值，增加信号量资源
+
+	// post之后用户可能已经析构了Result，只使用局部变量
+	for (auto& callback : callbacks)
+	{
+		callback();
+	}
+}
+
+void Result::onReady(std::function<void()> callback)
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		if (!isReady_)
+		{
+			callbacks_.emplace_back(std::move(callback));
+			return;
+		}
+	}
+	callback();
 }
 
-// û
+void Result::cancel()
+{
+	task_->cancel();
+}
+
+// 用户调用
 Any Result::get()
 {
 	if (!isValid_)
@@ -310,13 +341,13 @@ Any Result::get()
 		return "";
 	}
 
-	sem_.wait(); // Taskûִ꣬û߳
+	sem_.wait(); // Task任务没执行完，会阻塞用户的线程
 	return std::move(any_);
 }
 
 
-//---------------------------Taskʵ-------------------
-Task::Task():result_(nullptr)
+//---------------------------Task方法实现-------------------
+Task::Task():result_(nullptr), isCancelled_(false)
 {
 
 }
@@ -326,11 +357,94 @@ void Task::exec()
 {
 	if (result_ != nullptr)
 	{
-		result_->setVal(run()); // ﷢̬
+		// 取消的任务不执行，用空的Any唤醒等待的用户
+		result_->setVal(isCancelled_ ? Any() : run()); // 这里发生多态调用
 	}
 }
 
+void Task::cancel()
+{
+	isCancelled_ = true;
+}
+
+bool Task::isCancelled() const
+{
+	return isCancelled_;
+}
+
 void Task::setResult(Result* result)
 {
 	result_ = result;
 }
+
+
+//---------------------------whenAll/whenAny实现-------------------
+std::future<void> whenAll(const std::vector<Result*>& results)
+{
+	struct State
+	{
+		std::atomic<size_t> remaining_;
+		std::promise<void> promise_;
+	};
+
+	auto state = std::make_shared<State>();
+	// 多计一次，注册完成之前不会设置结果
+	state->remaining_ = results.size() + 1;
+	std::future<void> future = state->promise_.get_future();
+
+	auto finish = [state]() {
+		if (--state->remaining_ == 0)
+		{
+			state->promise_.set_value();
+		}
+	};
+	for (Result* result : results)
+	{
+		result->onReady(finish);
+	}
+	finish();
+	return future;
+}
+
+std::future<size_t> whenAny(const std::vector<Result*>& results, bool cancelOthers)
+{
+	struct State
+	{
+		std::atomic_bool isDone_;
+		std::vector<Result*> results_;
+		std::promise<size_t> promise_;
+	};
+
+	auto state = std::make_shared<State>();
+	state->isDone_ = false;
+	state->results_ = results;
+	std::future<size_t> future = state->promise_.get_future();
+
+	auto finish = [state, cancelOthers](size_t index) {
+		if (state->isDone_.exchange(true))
+		{
+			return;
+		}
+		if (cancelOthers)
+		{
+			for (size_t i = 0; i < state->results_.size(); i++)
+			{
+				if (i != index)
+				{
+					state->results_[i]->cancel();
+				}
+			}
+		}
+		state->promise_.set_value(index);
+	};
+
+	if (results.empty())
+	{
+		finish(0);
+	}
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		results[i]->onReady([finish, i]() { finish(i); });
+	}
+	return future;
+}
@@ -11,16 +11,17 @@
 #include <functional>
 #include <thread>
 #include <unordered_map>
+#include <future>
 
 
-// ֵ̳֧߳ģʽ
+// 线程池支持的模式
 enum class ThreadPoolMode
 {
-	MODE_FIXED, // ̸߳ǹ̶
-	MODE_CACHED // ̸߳ǿɶ̬
+	MODE_FIXED, // 线程个数是固定不变
+	MODE_CACHED // 线程个数是可动态增长
 };
 
-// Any :Խݵ
+// Any 类型:可以接收任意数据的类型
 class Any
 {
 public:
@@ -31,18 +32,18 @@ public:
 	Any(Any&&) = default;
 	Any& operator=(Any&&) = default;
 
-	// 캯Anyͽ
+	// 这个构造函数可以让Any类型接收任意其他的数据
 	template<typename T> // T:int	Derive<int>
 	Any(T data) :base_(std::make_unique<Derive<T>>(data)) // new Derive<T>(data)
 	{
 	}
 
-	// ܰAny洢dataȡ
+	// 这个方法能把Any对象里存储的data数据提取出来
 	template<typename T>
 	T cast_()
 	{
-		// ôbase_ҵָDerive󣬴ȡdataԱ
-		// ָ =ָ RTTI
+		// 我们怎么从base_找到它所指向的Derive对象，从他里面取出data成员变量
+		// 基类指针 =》派生类指针 RTTI
 		Derive<T>* pd = dynamic_cast<Derive<T>*>(base_.get());
 		if (pd == nullptr)
 		{
@@ -52,17 +53,17 @@ public:
 	}
 
 private:
-	// 
+	// 基类类型
 	class Base
 	{
 	public:
-		virtual ~Base() = default; // ڼ̳нṹǶϴ ޷ ʱʹ麯 
+		virtual ~Base() = default; // 在继承结构中如果基类是堆上创建 派生类的析构函数无法调用 此时基类析构函数使用虚函数 
 
 	private:
 
 	};
 
-	// 
+	// 派生类类型
 	template<typename T>
 	class Derive :public Base
 	{
@@ -70,11 +71,11 @@ private:
 		Derive(T data) :data_(data)
 		{
 		}
-		T data_; // 
+		T data_; // 保存了任意的其他类型
 	};
 
 private:
-	// һָ
+	// 定义一个基类指针
 	std::unique_ptr<Base> base_;
 };
 
@@ -87,22 +88,22 @@ public:
 
 	~Semaphore() = default;
 
-	// ȡһźԴ
+	// 获取一个信号量资源
 	void wait()
 	{
 		std::unique_lock<std::mutex> lock(mtx_);
-		// ȴźԴûԴĻǰ߳
+		// 等待信号量有资源，没有资源的话，会阻塞当前线程
 		cond_.wait(lock, [&]()->bool { return resLimit_ > 0; });
 		resLimit_--;
 	}
 
-	// һźԴ
+	// 增加一个信号量资源
 	void post()
 	{
 		std::unique_lock<std::mutex> lock(mtx_);
 		resLimit_++;
-		// linux£condition_variableʲôҲû
-		// ״̬ѾʧЧ޹
+		// linux下，condition_variable的析构函数什么也没做
+		// 导致这里状态已经失效，无故阻塞
 		cond_.notify_all();
 	}
 
@@ -113,29 +114,47 @@ private:
 
 };
 
-// Task Any͵ǰ
+// Task Any类型的前置声明
 class Task;
-// ʵֽύ̳߳صtaskִɺķֵResult
+// 实现接收提交到线程池的task任务执行完成后的返回值类型Result
 class Result
 {
 public:
 	Result(std::shared_ptr<Task> task, bool isValid = true);
 	~Result() = default;
 
-	// setValȡִķֵ
+	// setVal方法，获取任务执行完的返回值
 	void setVal(Any any);
 
-	// getûȡtaskֵ
+	// get方法，用户调用这个方法获取task返回值
 	Any get();
 
+	// 注册返回值就绪后调用的回调，已经就绪或者提交失败时立即在当前线程调用
+	// 回调在执行任务的线程上执行，应该很短，不能阻塞
+	void onReady(std::function<void()> callback);
+
+	// 取消任务：还没有开始执行的任务不再执行，get()得到空的Any
+	void cancel();
+
 private:
-	Any any_; // 洢ķֵ
-	Semaphore sem_; // ߳ͨź
-	std::shared_ptr<Task> task_; // ָӦȡֵ
-	std::atomic_bool isValid_; // ֵǷЧ
+	Any any_; // 存储任务的返回值
+	Semaphore sem_; // 线程通信信号量
+	std::shared_ptr<Task> task_; // 指向对应获取返回值的任务对象
+	std::atomic_bool isValid_; // 返回值是否有效
+	std::mutex mtx_; // 保护isReady_和callbacks_
+	bool isReady_; // 返回值是否已经就绪
+	std::vector<std::function<void()>> callbacks_; // 就绪后调用的回调
 };
 
-// 
+// 等待所有任务执行完		每个Result就绪时原子计数减一，减到0时返回的future就绪
+// results里的Result必须在返回的future就绪之前保持有效
+std::future<void> whenAll(const std::vector<Result*>& results);
+
+// 等待任意一个任务执行完		返回的future的值是第一个就绪的Result的下标，results为空时是0
+// cancelOthers为true时取消其它还没有开始执行的任务，它们的Result必须保持有效直到就绪
+std::future<size_t> whenAny(const std::vector<Result*>& results, bool cancelOthers = false);
+
+// 任务抽象基类
 class Task
 {
 public:
@@ -143,37 +162,44 @@ public:
 	Task();
 	~Task() = default;
 
-	// ûԶͣTask̳УдrunʵԶ 
+	// 用户可以自定义任意任务类型，从Task继承，重写run方法，实现自定义任务处理 
 	virtual Any run() = 0;
 
 	void exec();
 
 	void setResult(Result* result);
 
+	// 取消任务，还没有开始执行时exec不再调用run
+	void cancel();
+
+	// 是否已经被取消		执行时间长的run可以定期检查，提前返回
+	bool isCancelled() const;
+
 private:
-	// Result > Task
-	Result* result_; // ﲻҪʹָ ᵼָĽõԶòͷ 
+	// Result对象的生命周期 > Task对象
+	Result* result_; // 这里不要使用智能指针 将会导致智能指针的交叉引用导致永远得不到释放 
+	std::atomic_bool isCancelled_; // 是否已经被取消
 
 };
 
-// ߳
+// 线程类型
 class Thread
 {
 public:
-	// ̺߳
+	// 线程函数对象类型
 	using ThreadFunc = std::function<void(int)>;
 
 	Thread(ThreadFunc func);
 	~Thread();
 
-	// ߳
+	// 启动线程
 	void start();
 
-	// ȡ߳ID
+	// 获取线程ID
 	int getThreadId() const;
 
 private:
-	ThreadFunc func_; // ̺߳
+	ThreadFunc func_; // 线程函数对象
 	static int generateId_; 
 	int threadId_;
 };
@@ -186,70 +212,70 @@ pool.start();
 class MyTask: public Task
 {
 public:
-	void run(){ // ̴߳... }
+	void run(){ // 线程代码... }
 };
 
 pool.submitTask(std::make_shared<MyTask>());
 */
-// ̳߳
+// 线程池类型
 class ThreadPool
 {
 public:
 	ThreadPool();
 	~ThreadPool();
 
-	// ֹû̳߳ؽп
+	// 禁止用户对线程池进行拷贝操作
 	ThreadPool(const ThreadPool&) = delete;
 	ThreadPool& operator=(const ThreadPool&) = delete;
 
 
-	// ̳߳
-	void start(int initThreadSize = std::thread::hardware_concurrency()); // CPUĺ
+	// 启动线程池
+	void start(int initThreadSize = std::thread::hardware_concurrency()); // 返回CPU的核心数量
 
-	// ̳߳ģʽ
+	// 设置线程池模式
 	void setMode(ThreadPoolMode mode);
 
-	//// óʼ߳
+	//// 设置初始的线程数量
 	//void setinitThreadSize(int size);
 
-	// taskֵ
+	// 设置task队列上限阈值
 	void setTaskQueMaxThreshHold(int threshhold);
 
-	// ̳߳cachedģʽֵ߳
+	// 设置线程池cached模式下线程阈值
 	void setThreadSizeMaxThreshHold(int threadthreshhold);
 
-	// ̳߳ύ
+	// 给线程池提交任务
 	Result submitTask(std::shared_ptr<Task> sp);
 
 private:
-	// ̺߳		bind󶨳ɺ
+	// 定义线程函数		用bind绑定器绑定成函数对象
 	void threadFunc(int threadid);
 
-	// ̳߳״̬
+	// 检查线程池启动状态
 	bool checkRunningState() const;
 
 private:
-	//std::vector<Thread*> threads_; // ֱʹָҪֶɾ ڴй© ʹָԶ
-	//std::vector<std::unique_ptr<Thread>> threads_; // ߳б
+	//std::vector<Thread*> threads_; // 直接使用指针需要手动删除 避免内存泄漏 使用智能指针可以自动析构
+	//std::vector<std::unique_ptr<Thread>> threads_; // 线程列表
 	std::unordered_map<int, std::unique_ptr<Thread>> threads_;
-	int initThreadSize_; // ʼ߳
-	// cachedģʽ
-	std::atomic_int curThreadSize_; // ¼ǰ̳߳߳
-	int threadSizeThreshHold_; // ߳޵ֵ
-	std::atomic_int idleThreadSize_; // ¼̵߳
+	int initThreadSize_; // 初始的线程数量
+	// cached模式
+	std::atomic_int curThreadSize_; // 记录当前线程池里面线程数量
+	int threadSizeThreshHold_; // 线程数量上限的阈值
+	std::atomic_int idleThreadSize_; // 记录空闲线程的数量
 
 
-	std::queue<std::shared_ptr<Task>> taskQue_;// ָ ʵֶ̬ Ҫ֤ ʹָ
-	std::atomic_int taskSize_; //  ǵ̰߳ȫ ԭ
-	int taskQueMaxThreshHold_; // ޵ֵ
+	std::queue<std::shared_ptr<Task>> taskQue_;// 基类的指针或引用 实现多态 还需要保证任务的生命周期 使用智能指针
+	std::atomic_int taskSize_; // 任务数量 考虑到线程安全 用原子类型
+	int taskQueMaxThreshHold_; // 任务队列数量上限的阈值
 
-	std::mutex taskQueMtx_; // ֤е̰߳ȫ
-	std::condition_variable notFull_; // ʾв
-	std::condition_variable notEmpty_; // ʾв
-	std::condition_variable exitCond_; // ȴ߳Դȫ
+	std::mutex taskQueMtx_; // 保证任务队列的线程安全
+	std::condition_variable notFull_; // 表示任务队列不满
+	std::condition_variable notEmpty_; // 表示任务队列不空
+	std::condition_variable exitCond_; // 等待线程资源全部回收
 
-	ThreadPoolMode poolMode_; // ̳߳ģʽ
-	std::atomic_bool isPoolRunning_; // ʾǰ̳߳ص״̬
+	ThreadPoolMode poolMode_; // 线程池模式
+	std::atomic_bool isPoolRunning_; // 表示当前线程池的启动状态
 
 };
 
@@ -0,0 +1,1377 @@
+#ifndef BASICTHREADPOOL_H
+#define BASICTHREADPOOL_H
+
+#include <cstdint>
+
+#include "threadpool.h"
+#include "reactor.h"
+#include "scheduler.h"
+
+/*
+BasicThreadPool成员函数的实现		threadpool.h的最后包含这个文件
+自定义策略的线程池在使用它的翻译单元里实例化，默认策略的ThreadPool在threadpool.cpp里显式实例化
+*/
+
+const int TASK_MAX_THRESHHOLD = 2;//INT32_MAX;
+const int AFFINITY_STEAL_DELAY = 2; // 单位ms
+const size_t TASK_MAX_COST = SIZE_MAX; // 默认不限制开销
+const int TASK_BATCH_SIZE = 1; // 线程每次最多取的任务数量，默认不批量取
+
+// 调试日志		定义THREADPOOL_DEBUG时输出，需要观察任务的执行情况时使用startProfiling
+#ifdef THREADPOOL_DEBUG
+#define POOL_LOG(msg) (std::cout << msg << std::endl)
+#else
+#define POOL_LOG(msg) ((void)0)
+#endif
+
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::BasicThreadPool() : initThreadSize_(0), curThreadSize_(0), threadSizeThreshHold_(SizingPolicy::MAX_THREAD_SIZE), idleThreadSize_(0), taskSize_(0), taskQueMaxThreshHold_(TASK_MAX_THRESHHOLD), queuedCost_(0), peakQueuedCost_(0), taskQueMaxCost_(TASK_MAX_COST), failedTaskSize_(0), affinityStealDelay_(AFFINITY_STEAL_DELAY), blockedThreadSize_(0), taskBatchSize_(TASK_BATCH_SIZE), batchedTaskSize_(0), isShared_(false), weight_(1), runningSharedSize_(0), threadStackSize_(0), isLazyStart_(false), spawnedSlotSize_(0), spawnTreeSize_(0), readyThreadSize_(0), watchdog_(*this), isTimerStopped_(false), notFullWaiters_(0), poolMode_(ThreadPoolMode::MODE_FIXED), isPoolRunning_(false)
+{
+
+}
+
+// 开启线程池
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::start(int initThreadSize)
+{
+	// 设置线程池的启动状态
+	isPoolRunning_ = true;
+
+	// 记录初始线程个数
+	initThreadSize_ = initThreadSize;
+
+	// 启用了共享线程，不创建自己的线程，交给Scheduler调度
+	if (Scheduler::instance().isStarted())
+	{
+		isShared_ = true;
+		Scheduler::instance().attach(this, weight_);
+		return;
+	}
+
+	// 每个初始线程一个入队列，存放亲和到这个线程的任务
+	for (int i = 0; i < initThreadSize_; i++)
+	{
+		workerSlots_.emplace_back(std::make_unique<WorkerSlot>());
+	}
+
+	std::unique_lock<std::mutex> lock(taskQueMtx_);
+
+	// 延迟启动时不创建线程，有任务时pushTask按需创建
+	if (isLazyStart_)
+	{
+		return;
+	}
+
+	// 只创建第0个线程，线程i启动后先创建线程2i+1和2i+2，线程的创建和初始化都并行进行
+	spawnedSlotSize_ = initThreadSize_;
+	spawnTreeSize_ = initThreadSize_;
+	if (initThreadSize_ > 0)
+	{
+		addThread(0);
+	}
+
+	// 等待所有线程完成初始化(包括workerInit_)，返回后线程已经在等待任务
+	// 线程创建完子线程后才计入就绪，所有线程就绪时树上的线程都已经创建
+	readyCond_.wait(lock, [&]()->bool { return readyThreadSize_ >= initThreadSize_; });
+	spawnTreeSize_ = 0;
+}
+
+// 设置线程池模式
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::setMode(ThreadPoolMode mode)
+{
+	// 编译期确定了线程数量策略时没有运行时的模式
+	if constexpr (SizingPolicy::IS_RUNTIME)
+	{
+		std::lock_guard<std::mutex> lock(taskQueMtx_);
+		poolMode_ = mode;
+		// 切换到fixed后，多出来的线程检查后退出
+		notifyWorkers();
+	}
+}
+
+// 修改初始的线程数量
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::resize(int threadSize)
+{
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	threadSize = std::max(threadSize, 1);
+	if (!checkRunningState())
+	{
+		// 还没有启动，线程数量由start的参数决定
+		return;
+	}
+
+	initThreadSize_ = threadSize;
+	if (isShared_)
+	{
+		// 共享线程模式下只是占用共享线程的上限
+		Scheduler::instance().notify();
+		return;
+	}
+
+	// 入队列只增加不删除，退出的线程的入队列里剩下的任务由其它线程窃取
+	while ((int)workerSlots_.size() < threadSize)
+	{
+		workerSlots_.emplace_back(std::make_unique<WorkerSlot>());
+	}
+
+	// 延迟启动时还没有创建的初始线程仍然由pushTask按需创建
+	if (!isLazyStart_)
+	{
+		spawnedSlotSize_ = std::max(spawnedSlotSize_, threadSize);
+	}
+	for (int i = 0; i < std::min(threadSize, spawnedSlotSize_); i++)
+	{
+		// 编号没有超出范围、还没有退出的线程继续使用原来的入队列
+		if (!workerSlots_[i]->hasThread_)
+		{
+			addThread(i);
+		}
+	}
+
+	// 减少时唤醒空闲线程，多余的线程检查后退出
+	notifyWorkers();
+}
+
+// 设置task队列上限阈值
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::setTaskQueMaxThreshHold(int threshhold)
+{
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	taskQueMaxThreshHold_ = threshhold;
+	// 调大后等待的提交者可以继续
+	notFull_.notify_all();
+}
+
+// 设置线程的栈大小
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::setThreadStackSize(size_t stackSize)
+{
+	if (checkRunningState())
+	{
+		return;
+	}
+	threadStackSize_ = stackSize;
+}
+
+// 设置线程名称的前缀
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::setThreadName(const std::string& name)
+{
+	if (checkRunningState())
+	{
+		return;
+	}
+	threadName_ = name;
+}
+
+// 设置延迟启动
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::setLazyStart(bool isLazy)
+{
+	if (checkRunningState())
+	{
+		return;
+	}
+	isLazyStart_ = isLazy;
+}
+
+// 设置排队任务的开销之和的上限
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::setTaskQueMaxCost(size_t maxCost)
+{
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	taskQueMaxCost_ = maxCost;
+	// 调大后等待的提交者可以继续
+	notFull_.notify_all();
+}
+
+// 获取统计数据		不加锁，各项数据不是同一时刻的快照
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+ThreadPoolStats BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::getStats() const
+{
+	ThreadPoolStats stats;
+	stats.threadSize_ = curThreadSize_;
+	stats.idleThreadSize_ = idleThreadSize_;
+	stats.taskSize_ = taskSize_;
+	stats.queuedCost_ = queuedCost_;
+	stats.peakQueuedCost_ = peakQueuedCost_;
+	stats.failedTaskSize_ = failedTaskSize_;
+	return stats;
+}
+
+// 设置线程池cached模式下线程阈值
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::setThreadSizeMaxThreshHold(int threadthreshhold)
+{
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	// fixed模式下也记录，切换到cached模式时生效
+	threadSizeThreshHold_ = threadthreshhold;
+	// 调小后多出来的线程检查后退出
+	notifyWorkers();
+}
+
+// 设置亲和性任务的窃取延迟
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::setAffinityStealDelay(std::chrono::milliseconds delay)
+{
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	affinityStealDelay_ = delay;
+	// 等待窃取的线程按新的延迟重新计算醒来的时间
+	notifyWorkers();
+}
+
+// 设置线程每次最多取的任务数量
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::setTaskBatchSize(int batchSize)
+{
+	// 下一次从任务队列取任务时生效，已经在缓冲里的任务照常执行
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	taskBatchSize_ = std::max(batchSize, 1);
+}
+
+// 设置在共享线程上的权重
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::setWeight(int weight)
+{
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	weight_ = std::max(weight, 1);
+	if (isShared_)
+	{
+		Scheduler::instance().setWeight(this, weight_);
+	}
+}
+
+// 设置线程启动时调用的函数
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::setWorkerInit(std::function<void(int)> func)
+{
+	if (checkRunningState())
+	{
+		return;
+	}
+	workerInit_ = std::move(func);
+}
+
+// 设置线程退出时调用的函数
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::setWorkerExit(std::function<void(int)> func)
+{
+	if (checkRunningState())
+	{
+		return;
+	}
+	workerExit_ = std::move(func);
+}
+
+// 分配最小的空闲编号		调用者已经持有taskQueMtx_
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+int BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::acquireWorkerIndex()
+{
+	auto it = std::find(workerIndexUsed_.begin(), workerIndexUsed_.end(), false);
+	int index = (int)(it - workerIndexUsed_.begin());
+	if (it == workerIndexUsed_.end())
+	{
+		workerIndexUsed_.push_back(true);
+	}
+	else
+	{
+		*it = true;
+	}
+	return index;
+}
+
+// 归还编号		调用者已经持有taskQueMtx_
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::releaseWorkerIndex(int index)
+{
+	workerIndexUsed_[index] = false;
+}
+
+// 任务队列是否已满		调用者已经持有taskQueMtx_
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+bool BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::isFull(const TaskOption& option) const
+{
+	// 开销的比较写成减法，避免上限为SIZE_MAX时溢出
+	if (taskSize_ >= taskQueMaxThreshHold_
+		|| (queuedCost_ > 0 && (queuedCost_ > taskQueMaxCost_ || option.cost_ > taskQueMaxCost_ - queuedCost_)))
+	{
+		return true;
+	}
+
+	// 有界队列还要看租户的队列		亲和性任务放进线程的入队列，不占用租户的队列
+	if constexpr (QueuePolicy::IS_BOUNDED)
+	{
+		auto it = tenants_.find(option.tenant_);
+		return !option.hasAffinity_ && it != tenants_.end() && it->second->taskQue_.full();
+	}
+	return false;
+}
+
+// 等待任务队列不满		调用者已经持有taskQueMtx_
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+bool BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::waitNotFull(std::unique_lock<std::mutex>& lock, const TaskOption& option)
+{
+	// 用户提交任务，最长不能阻塞超过1s，否则判断提交任务失败，返回
+	notFullWaiters_++;
+	bool isNotFull = notFull_.wait_for(lock, std::chrono::seconds(1), [&]()->bool { return !isFull(option); });
+	notFullWaiters_--;
+	if (!isNotFull)
+	{
+		// 表示notFull_等待1s，条件依然没有满足
+		std::cerr << "task queue is full, submit task fail." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// 把任务放入任务队列		调用者已经持有taskQueMtx_
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::pushTask(Task task, const TaskOption& option)
+{
+	if (profiler_.isEnabled())
+	{
+		task = profiler_.wrap(std::move(task), option.label_);
+	}
+	if (watchdog_.isEnabled())
+	{
+		task = watchdog_.wrap(std::move(task), option.label_);
+	}
+
+	Tenant* tenant = findTenant(option.tenant_);
+	tenant->submittedSize_++;
+	int slot = option.hasAffinity_ ? affinitySlot(option.affinityKey_) : -1;
+
+	// 有线程在等待任务时直接交给它，不经过任务队列
+	if (handOff(task, tenant, slot))
+	{
+		return;
+	}
+
+	tenant->queuedSize_++;
+	QueuedTask queued{ std::move(task), option.cost_, std::chrono::high_resolution_clock().now(), tenant };
+	if (slot >= 0)
+	{
+		workerSlots_[slot]->taskQue_.emplace(std::move(queued));
+	}
+	else
+	{
+		// Strand、限流执行器、Reactor等内部提交不等待队列不满，有界队列满时放进溢出队列，不能丢弃
+		// 溢出队列不空时新任务也排在后面，保持提交顺序
+		if (!tenant->overflowQue_.empty() || !tenant->taskQue_.push(std::move(queued)))
+		{
+			tenant->overflowQue_.emplace_back(std::move(queued));
+		}
+		if (!tenant->isActive_)
+		{
+			// 排到这一轮的最后，轮到时获得配额
+			tenant->isActive_ = true;
+			tenant->deficit_ = 0;
+			activeTenants_.push_back(tenant);
+		}
+	}
+	taskSize_++;
+	queuedCost_ += option.cost_;
+	if (queuedCost_ > peakQueuedCost_)
+	{
+		peakQueuedCost_ = queuedCost_.load();
+	}
+
+	// 共享线程模式下没有自己的线程，唤醒一个共享线程
+	if (isShared_)
+	{
+		Scheduler::instance().notify();
+		return;
+	}
+
+	// 因为新放了任务，任务队列肯定不空，通知等待的线程，赶快分配线程执行任务
+	notifyWorkers();
+
+	// 延迟启动 初始线程还没有全部创建，空闲线程不够时创建下一个初始线程
+	if (spawnedSlotSize_ < initThreadSize_ && taskSize_ > idleThreadSize_)
+	{
+		POOL_LOG(">>> create initial thread!!!");
+		addThread(spawnedSlotSize_++);
+	}
+	// cached模式 任务处理比较紧急 场景：小而块的任务 需要根据任务数量和空闲线程数量，判断是否需要创建新的线程出来
+	else if (isCachedMode() && taskSize_ > idleThreadSize_ && curThreadSize_ < threadSizeThreshHold_)
+	{
+		POOL_LOG(">>> create new thread!!!");
+		addThread();
+	}
+	else if (needCompensation())
+	{
+		// 有线程阻塞在blockingSection里，创建补偿线程，阻塞结束后补偿线程退出
+		POOL_LOG(">>> create compensation thread!!!");
+		addThread();
+	}
+}
+
+// 获取锁后放入任务
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::scheduleTask(Task task, const TaskOption& option)
+{
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	pushTask(std::move(task), option);
+}
+
+// 等待任务队列不满后放入任务
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+bool BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::scheduleTaskFor(Task& task, std::chrono::milliseconds timeout)
+{
+	std::unique_lock<std::mutex> lock(taskQueMtx_);
+	notFullWaiters_++;
+	bool isNotFull = notFull_.wait_for(lock, timeout, [&]()->bool { return isPoolRunning_ && !isFull(TaskOption()); });
+	notFullWaiters_--;
+	if (!isNotFull)
+	{
+		return false;
+	}
+	pushTask(std::move(task));
+	return true;
+}
+
+// 创建并启动一个线程		调用者已经持有taskQueMtx_
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::addThread(int slot)
+{
+	// 创建新的线程对象
+	auto ptr = std::make_unique<Thread>(std::bind(&BasicThreadPool::threadFunc, this, std::placeholders::_1, slot)); // placeholders 参数占位符
+	ptr->setStackSize(threadStackSize_);
+	int threadId = ptr->getThreadId();
+	threads_.emplace(threadId, std::move(ptr));
+	if (slot >= 0)
+	{
+		workerSlots_[slot]->hasThread_ = true;
+	}
+
+	// 启动线程
+	profiler_.threadSpawn(threadId);
+	threads_[threadId]->start();
+	// 修改线程个数相关的变量
+	curThreadSize_++;
+	idleThreadSize_++;
+}
+
+// 是否需要创建补偿线程		有任务没有空闲线程执行，并且没有阻塞的线程数量不足initThreadSize_
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+bool BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::needCompensation() const
+{
+	return blockedThreadSize_ > 0
+		&& taskSize_ > idleThreadSize_
+		&& curThreadSize_ - blockedThreadSize_ < initThreadSize_
+		&& curThreadSize_ < threadSizeThreshHold_;
+}
+
+// 补偿线程是否多余		阻塞结束后，fixed模式下没有阻塞的线程数量超过initThreadSize_
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+bool BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::isSurplusThread(int slot) const
+{
+	// 初始线程：resize减少后编号超出范围，自己的入队列里的任务执行完再退出
+	if (slot >= 0)
+	{
+		return slot >= initThreadSize_ && workerSlots_[slot]->taskQue_.empty();
+	}
+	if (isCachedMode())
+	{
+		return curThreadSize_ > threadSizeThreshHold_;
+	}
+	return curThreadSize_ - blockedThreadSize_ > initThreadSize_;
+}
+
+// 当前线程进入阻塞区
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::enterBlocking()
+{
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	blockedThreadSize_++;
+	if (needCompensation())
+	{
+		POOL_LOG(">>> create compensation thread!!!");
+		addThread();
+	}
+	if (batchedTaskSize_ > 0)
+	{
+		// 当前线程的缓冲里可能还有任务，唤醒空闲线程窃取
+		notifyWorkers();
+	}
+}
+
+// 当前线程离开阻塞区
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::leaveBlocking()
+{
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	blockedThreadSize_--;
+	// 唤醒空闲线程，多余的补偿线程检查后退出
+	notifyWorkers();
+}
+
+// 一致性哈希		Jump Consistent Hash，线程数量变化时只有少量key需要换线程
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+int BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::affinitySlot(size_t affinityKey) const
+{
+	// resize减少后只映射到还在使用的入队列
+	int buckets = std::min((int)workerSlots_.size(), (int)initThreadSize_);
+	if (buckets == 0)
+	{
+		return -1;
+	}
+
+	uint64_t key = affinityKey;
+	int64_t b = -1;
+	int64_t j = 0;
+	while (j < buckets)
+	{
+		b = j;
+		key = key * 2862933555777941757ULL + 1;
+		j = (int64_t)((b + 1) * (double(1LL << 31) / double((key >> 33) + 1)));
+	}
+	return (int)b;
+}
+
+// 查找租户		调用者已经持有taskQueMtx_
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+auto BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::findTenant(int tenant) -> Tenant*
+{
+	auto& ptr = tenants_[tenant];
+	if (ptr == nullptr)
+	{
+		ptr = std::make_unique<Tenant>();
+		ptr->id_ = tenant;
+	}
+	return ptr.get();
+}
+
+// 设置租户的权重
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::setTenantWeight(int tenant, int weight)
+{
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	findTenant(tenant)->weight_ = std::max(weight, 1);
+}
+
+// 设置租户的并发上限
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::setTenantMaxConcurrency(int tenant, int maxConcurrency)
+{
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	findTenant(tenant)->maxRunningSize_ = std::max(maxConcurrency, 0);
+	// 上限可能放宽了，唤醒线程重新检查
+	notifyWorkers();
+	if (isShared_)
+	{
+		Scheduler::instance().notify();
+	}
+}
+
+// 获取所有租户的统计数据
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+std::vector<TenantStats> BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::getTenantStats() const
+{
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	std::vector<TenantStats> stats;
+	for (auto& pair : tenants_)
+	{
+		const Tenant& tenant = *pair.second;
+		stats.push_back({ tenant.id_, tenant.queuedSize_, tenant.runningSize_, tenant.submittedSize_, tenant.completedSize_ });
+	}
+	std::sort(stats.begin(), stats.end(), [](const TenantStats& a, const TenantStats& b) { return a.tenant_ < b.tenant_; });
+	return stats;
+}
+
+// 从队列里取出任务后的记录		调用者已经持有taskQueMtx_
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::takeTask(QueuedTask& queued, Task& task, Tenant*& tenant)
+{
+	task = std::move(queued.task_);
+	tenant = queued.tenant_;
+	queuedCost_ -= queued.cost_;
+	tenant->queuedSize_--;
+	tenant->runningSize_++;
+}
+
+// deficit round robin		调用者已经持有taskQueMtx_
+// 队头的租户轮到时获得weight_的配额，每取一个任务用掉1，配额用完或者队列空了换下一个租户
+// 达到并发上限的租户这一轮跳过，最多看一圈
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+bool BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::popTenantTask(Task& task, Tenant*& tenant)
+{
+	for (size_t n = activeTenants_.size(); n > 0; n--)
+	{
+		Tenant* front = activeTenants_.front();
+		if (front->maxRunningSize_ > 0 && front->runningSize_ >= front->maxRunningSize_)
+		{
+			front->deficit_ = 0;
+			activeTenants_.pop_front();
+			activeTenants_.push_back(front);
+			continue;
+		}
+
+		if (front->deficit_ <= 0)
+		{
+			front->deficit_ += front->weight_;
+		}
+		QueuedTask queued;
+		front->taskQue_.pop(queued);
+		takeTask(queued, task, tenant);
+		front->deficit_--;
+		if (!front->overflowQue_.empty())
+		{
+			// 队列空出一个位置，溢出队列的第一个任务补进来
+			front->taskQue_.push(std::move(front->overflowQue_.front()));
+			front->overflowQue_.pop_front();
+		}
+
+		if (front->taskQue_.empty())
+		{
+			front->isActive_ = false;
+			front->deficit_ = 0;
+			activeTenants_.pop_front();
+		}
+		else if (front->deficit_ <= 0)
+		{
+			activeTenants_.pop_front();
+			activeTenants_.push_back(front);
+		}
+		return true;
+	}
+	return false;
+}
+
+// 任务执行完		不持有taskQueMtx_
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::finishTask(Tenant* tenant)
+{
+	tenant->completedSize_++;
+	tenant->runningSize_--;
+	if (tenant->maxRunningSize_ > 0)
+	{
+		// 这个租户可能有任务在等待并发名额
+		std::lock_guard<std::mutex> lock(taskQueMtx_);
+		notifyWorkers();
+	}
+}
+
+// 执行任务		post提交的任务抛出的异常不能离开线程，否则整个进程std::terminate
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::runTask(Task& task)
+{
+	try
+	{
+		task();
+	}
+	catch (const std::exception& e)
+	{
+		failedTaskSize_++;
+		std::cerr << "task threw an exception: " << e.what() << std::endl;
+	}
+	catch (...)
+	{
+		failedTaskSize_++;
+		std::cerr << "task threw an unknown exception." << std::endl;
+	}
+}
+
+// 取一个当前线程可以执行的任务		调用者已经持有taskQueMtx_
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+bool BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::popTask(int slot, Task& task, Tenant*& tenant, std::chrono::high_resolution_clock::time_point& nextSteal)
+{
+	// 1.自己的入队列
+	if (slot >= 0 && !workerSlots_[slot]->taskQue_.empty())
+	{
+		takeTask(workerSlots_[slot]->taskQue_.front(), task, tenant);
+		workerSlots_[slot]->taskQue_.pop();
+		return true;
+	}
+
+	// 2.租户的队列
+	if (popTenantTask(task, tenant))
+	{
+		return true;
+	}
+
+	// 3.其它线程入队列里等待超过窃取延迟的任务		线程池结束时不再等待，尽快执行完所有任务
+	auto nowTime = std::chrono::high_resolution_clock().now();
+	auto delay = isPoolRunning_ ? affinityStealDelay_ : std::chrono::milliseconds(0);
+	nextSteal = std::chrono::high_resolution_clock::time_point::max();
+	for (auto& other : workerSlots_)
+	{
+		if (other->taskQue_.empty())
+		{
+			continue;
+		}
+
+		auto stealTime = other->taskQue_.front().enqueueTime_ + delay;
+		if (stealTime <= nowTime)
+		{
+			takeTask(other->taskQue_.front(), task, tenant);
+			other->taskQue_.pop();
+			return true;
+		}
+		nextSteal = std::min(nextSteal, stealTime);
+	}
+	return false;
+}
+
+// 把任务直接交给一个等待的线程
+// 只在任务队列里没有排在它前面的任务时交出：亲和性任务、租户还有排队的任务或者达到了并发上限时放进队列
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+bool BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::handOff(Task& task, Tenant* tenant, int slot)
+{
+	if (parkedWorkers_.empty() || isShared_ || slot >= 0 || !tenant->taskQue_.empty()
+		|| (tenant->maxRunningSize_ > 0 && tenant->runningSize_ >= tenant->maxRunningSize_))
+	{
+		return false;
+	}
+
+	// 只唤醒这一个线程，不修改taskSize_，不通知notFull_
+	WorkerPark* park = parkedWorkers_.back();
+	parkedWorkers_.pop_back();
+	park->task_ = std::move(task);
+	park->tenant_ = tenant;
+	park->hasTask_ = true;
+	park->isNotified_ = true;
+	tenant->runningSize_++;
+	park->cond_.notify_one();
+	return true;
+}
+
+// 当前线程等待
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+bool BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::parkWorker(WorkerPark& park, std::unique_lock<std::mutex>& lock, std::chrono::high_resolution_clock::time_point deadline)
+{
+	park.isNotified_ = false;
+	parkedWorkers_.push_back(&park);
+	auto ready = [&]()->bool { return park.isNotified_; };
+	bool isNotified = true;
+	if (deadline == std::chrono::high_resolution_clock::time_point::max())
+	{
+		park.idle_.wait(lock, park.cond_, ready);
+	}
+	else
+	{
+		isNotified = park.idle_.waitUntil(lock, park.cond_, deadline, ready);
+	}
+
+	// 直接交出任务时handOff已经把它移除了
+	auto it = std::find(parkedWorkers_.begin(), parkedWorkers_.end(), &park);
+	if (it != parkedWorkers_.end())
+	{
+		parkedWorkers_.erase(it);
+	}
+	return isNotified;
+}
+
+// 唤醒所有等待的线程
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::notifyWorkers()
+{
+	for (WorkerPark* park : parkedWorkers_)
+	{
+		park->isNotified_ = true;
+		park->cond_.notify_one();
+	}
+}
+
+// 这次从任务队列里取的任务数量
+// 排队的任务平均分给所有空闲线程(包括自己)，其它空闲线程仍然能从任务队列里取到任务
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+int BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::batchSize() const
+{
+	int idle = std::max((int)idleThreadSize_, 1);
+	return std::min(taskBatchSize_, std::max((taskSize_ - batchedTaskSize_ + 1) / idle, 1));
+}
+
+// 从自己的缓冲里取一个任务
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+bool BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::popBatchTask(TaskBatch* batch, Task& task, Tenant*& tenant)
+{
+	{
+		std::lock_guard<std::mutex> lock(batch->mtx_);
+		if (batch->taskQue_.empty())
+		{
+			return false;
+		}
+		takeBatchedTask(batch->taskQue_.front(), task, tenant);
+		batch->taskQue_.pop_front();
+	}
+
+	// 有提交者在等待任务队列不满		获取一下taskQueMtx_再通知，它要么已经看到减少后的数量，要么已经在等待
+	if (notFullWaiters_ > 0)
+	{
+		std::lock_guard<std::mutex> lock(taskQueMtx_);
+		notFull_.notify_all();
+	}
+	return true;
+}
+
+// 缓冲里的任务开始执行
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::takeBatchedTask(BatchedTask& batched, Task& task, Tenant*& tenant)
+{
+	task = std::move(batched.task_);
+	tenant = batched.tenant_;
+	queuedCost_ -= batched.cost_;
+	batchedTaskSize_--;
+	taskSize_--;
+}
+
+// 从其它线程的缓冲里窃取一个任务
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+bool BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::stealBatchTask(Task& task, Tenant*& tenant)
+{
+	if (batchedTaskSize_ == 0)
+	{
+		return false;
+	}
+	for (auto& batch : taskBatches_)
+	{
+		std::lock_guard<std::mutex> lock(batch->mtx_);
+		if (!batch->taskQue_.empty())
+		{
+			// 从队尾窃取，队头是缓冲所属线程马上要执行的任务
+			takeBatchedTask(batch->taskQue_.back(), task, tenant);
+			batch->taskQue_.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+// 开始记录任务时间线
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::startProfiling()
+{
+	profiler_.start();
+}
+
+// 停止记录任务时间线
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::stopProfiling()
+{
+	profiler_.stop();
+}
+
+// 导出任务时间线
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::exportTrace(std::ostream& out) const
+{
+	profiler_.exportTrace(out);
+}
+
+// 启动看门狗
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::startWatchdog(std::chrono::milliseconds threshold, WatchdogCallback callback)
+{
+	watchdog_.start(threshold, std::move(callback));
+}
+
+// 停止看门狗
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::stopWatchdog()
+{
+	watchdog_.stop();
+}
+
+// 所有租户累计执行完的任务数量
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+uint64_t BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::completedTaskSize() const
+{
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	uint64_t completed = 0;
+	for (auto& pair : tenants_)
+	{
+		completed += pair.second->completedSize_;
+	}
+	return completed;
+}
+
+// 排队的任务数量		不加锁
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+int BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::pendingTaskSize() const
+{
+	return taskSize_;
+}
+
+#ifdef __linux__
+// 启动异步IO线程
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::startReactor(bool useIoUring)
+{
+	std::lock_guard<std::mutex> lock(reactorMtx_);
+	if (reactor_ == nullptr)
+	{
+		reactor_ = std::make_unique<Reactor>(*this, useIoUring);
+	}
+}
+
+// 异步读
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+TaskFuture<ssize_t> BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::asyncRead(int fd, void* buf, size_t len, off_t off)
+{
+	startReactor();
+	auto req = std::make_unique<IoRequest>();
+	req->op_ = IoRequest::READ;
+	req->fd_ = fd;
+	req->buf_ = buf;
+	req->len_ = len;
+	req->off_ = off;
+	req->completion_ = std::make_shared<TaskCompletion>();
+	TaskFuture<ssize_t> result(req->promise_.get_future(), req->completion_);
+	reactor_->submit(std::move(req));
+	return result;
+}
+
+// 异步写
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+TaskFuture<ssize_t> BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::asyncWrite(int fd, const void* buf, size_t len, off_t off)
+{
+	startReactor();
+	auto req = std::make_unique<IoRequest>();
+	req->op_ = IoRequest::WRITE;
+	req->fd_ = fd;
+	req->buf_ = const_cast<void*>(buf);
+	req->len_ = len;
+	req->off_ = off;
+	req->completion_ = std::make_shared<TaskCompletion>();
+	TaskFuture<ssize_t> result(req->promise_.get_future(), req->completion_);
+	reactor_->submit(std::move(req));
+	return result;
+}
+#endif
+
+// 创建串行执行器
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+std::shared_ptr<Strand> BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::makeStrand()
+{
+	// Strand的构造函数是私有的，不能使用make_shared
+	return std::shared_ptr<Strand>(new Strand(*this));
+}
+
+// 创建限制并发的执行器
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+std::shared_ptr<ThrottledExecutor> BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::limited(int maxConcurrent)
+{
+	return std::shared_ptr<ThrottledExecutor>(new ThrottledExecutor(*this, std::max(maxConcurrent, 1), 0, 1));
+}
+
+// 创建限制速率的执行器
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+std::shared_ptr<ThrottledExecutor> BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::rateLimited(double tasksPerSec, int burst)
+{
+	return std::shared_ptr<ThrottledExecutor>(new ThrottledExecutor(*this, 0, tasksPerSec, std::max(burst, 1)));
+}
+
+// 到time时在定时线程上调用func
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::postAfter(std::chrono::steady_clock::time_point time, Task func)
+{
+	std::lock_guard<std::mutex> lock(timerMtx_);
+	if (isTimerStopped_)
+	{
+		return;
+	}
+	if (!timerThread_.joinable())
+	{
+		timerThread_ = std::thread(&BasicThreadPool::timerFunc, this);
+	}
+	// 新的定时任务是最早的，定时线程要提前醒来
+	bool isEarliest = timers_.empty() || time < timers_.begin()->first;
+	timers_.emplace(time, std::move(func));
+	if (isEarliest)
+	{
+		timerCond_.notify_one();
+	}
+}
+
+// 停止定时线程
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::stopTimer()
+{
+	std::multimap<std::chrono::steady_clock::time_point, Task> dropped;
+	{
+		std::lock_guard<std::mutex> lock(timerMtx_);
+		isTimerStopped_ = true;
+		timerCond_.notify_all();
+		// 定时任务持有执行器的shared_ptr，不持有锁析构
+		dropped.swap(timers_);
+	}
+	if (timerThread_.joinable())
+	{
+		timerThread_.join();
+	}
+}
+
+// 定时线程函数
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::timerFunc()
+{
+	std::unique_lock<std::mutex> lock(timerMtx_);
+	while (!isTimerStopped_)
+	{
+		if (timers_.empty())
+		{
+			timerCond_.wait(lock);
+			continue;
+		}
+
+		auto time = timers_.begin()->first;
+		if (std::chrono::steady_clock::now() < time)
+		{
+			timerCond_.wait_until(lock, time);
+			continue;
+		}
+
+		Task func = std::move(timers_.begin()->second);
+		timers_.erase(timers_.begin());
+		// 不持有锁调用，func里可以再postAfter
+		lock.unlock();
+		func();
+		lock.lock();
+	}
+}
+
+// 定义线程函数		线程池的所有线程从任务队列里面消费任务
+// 线程函数返回，相应的线程也就结束了
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::threadFunc(int threadid, int slot)
+{
+	setCurrentPool(this);
+	Profiler::setCurrentThread(threadid);
+	TaskBatch* batch = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(taskQueMtx_);
+		// start创建初始线程时，每个线程继续创建它在树上的两个子线程
+		for (int child = 2 * slot + 1; slot >= 0 && child <= 2 * slot + 2 && child < spawnTreeSize_; child++)
+		{
+			if (!workerSlots_[child]->hasThread_)
+			{
+				addThread(child);
+			}
+		}
+		setCurrentWorkerIndex(acquireWorkerIndex());
+		if (currentWorkerIndex() >= (int)taskBatches_.size())
+		{
+			taskBatches_.emplace_back(std::make_unique<TaskBatch>());
+		}
+		batch = taskBatches_[currentWorkerIndex()].get();
+	}
+	if (!threadName_.empty())
+	{
+		Thread::setCurrentName(threadName_ + "-" + std::to_string(currentWorkerIndex()));
+	}
+	if (workerInit_)
+	{
+		workerInit_(currentWorkerIndex());
+	}
+	{
+		// 通知start线程已经就绪
+		std::lock_guard<std::mutex> lock(taskQueMtx_);
+		readyThreadSize_++;
+		readyCond_.notify_all();
+	}
+	auto lastTime = std::chrono::high_resolution_clock().now();
+	bool isIdle = true; // 是否计入了idleThreadSize_
+	WorkerPark park; // 等待任务时使用
+
+	//while(isPoolRunning_)
+	// 所有任务必须执行完成，线程池才可以回收线程资源
+	for (;;)
+	{
+		Task task;
+		Tenant* tenant = nullptr;
+
+		// 先执行自己缓冲里的任务，缓冲空了才获取taskQueMtx_
+		if (!popBatchTask(batch, task, tenant))
+		{
+			if (!isIdle)
+			{
+				isIdle = true;
+				idleThreadSize_++;
+				lastTime = std::chrono::high_resolution_clock().now(); // 更新线程执行完任务时间
+			}
+
+			// 获取锁
+			std::unique_lock<std::mutex> lock(taskQueMtx_);
+
+			POOL_LOG("tid: " << std::this_thread::get_id() << "尝试获取任务...");
+
+			// cached模式下，有可能已经创建了很多的线程，但是空闲时间超过60s，多余线程结束回收
+			// 超过initThreadSize_数量的线程要进行回收
+			// 当前时间 - 上一次线程执行的时间 > 60s
+
+			// 每一秒中返回一次 如何区分：超时返回 与 有任务待执行返回
+			// 锁 + 双重判断 
+			auto nextSteal = std::chrono::high_resolution_clock::time_point::max();
+			bool isHandedOff = false; // 任务是不是直接交给当前线程的
+			for (;;)
+			{
+				// 阻塞区已经结束或者线程数量调小了，多余的线程回收
+				if (isSurplusThread(slot))
+				{
+					curThreadSize_--;
+					idleThreadSize_--;
+					if (slot >= 0)
+					{
+						workerSlots_[slot]->hasThread_ = false;
+					}
+					exitThread(threadid, lock);
+					return;
+				}
+
+				if (popTask(slot, task, tenant, nextSteal))
+				{
+					// 任务已经由popTask从任务队列中取出
+					taskSize_--;
+					break;
+				}
+
+				// 任务队列空了，从其它线程的缓冲里窃取		stealBatchTask已经从taskSize_里减去
+				if (stealBatchTask(task, tenant))
+				{
+					break;
+				}
+
+				// 线程池要结束，回收线程资源  死锁问题解决 1.pool现成先获取锁  2.线程池里面的线程先获取锁导致
+				if (!isPoolRunning_)
+				{
+					exitThread(threadid, lock);
+					return; // 线程函数结束，线程结束
+				}
+
+				if (isCachedMode())
+				{
+					// 条件变量超时返回		其它线程入队列里有任务时，最晚在可以窃取的时候醒来
+					auto waitTime = std::chrono::high_resolution_clock().now() + std::chrono::seconds(1);
+					if (!parkWorker(park, lock, std::min(waitTime, nextSteal)) && !park.hasTask_
+						&& std::chrono::high_resolution_clock().now() >= waitTime)
+					{
+						auto nowTime = std::chrono::high_resolution_clock().now();
+						auto during = std::chrono::duration_cast<std::chrono::seconds>(nowTime - lastTime);
+						if (during.count() >= SizingPolicy::MAX_IDLE_SECONDS && curThreadSize_ > initThreadSize_) // 否则将回收所有线程
+						{
+							// 开始回收线程
+							// 记录线程数量的相关变量的值修改
+							// 把线程对象线程列表容器中删除		没有办法确定 threadFunc 《=》 thread对象
+							// threadId => thread对象 => 删除
+							curThreadSize_--;
+							idleThreadSize_--;
+							if (slot >= 0)
+							{
+								workerSlots_[slot]->hasThread_ = false;
+							}
+							exitThread(threadid, lock);
+							return;
+						}
+					}
+				}
+				else
+				{
+					// 等待任务		其它线程入队列里有任务时，等到可以窃取的时候
+					parkWorker(park, lock, nextSteal);
+				}
+
+				// 提交的任务直接交给了当前线程
+				if (park.hasTask_)
+				{
+					task = std::move(park.task_);
+					tenant = park.tenant_;
+					park.hasTask_ = false;
+					isHandedOff = true;
+					break;
+				}
+			}
+
+			idleThreadSize_--;
+			isIdle = false;
+
+			POOL_LOG("tid: " << std::this_thread::get_id() << "尝试获取任务成功...");
+
+			// 直接交过来的任务没有经过任务队列，不需要下面的批量取和通知
+			if (!isHandedOff)
+			{
+				// 任务多时一次多取几个放进自己的缓冲，加锁、通知和计数的开销由这一批任务分摊
+				int size = batchSize();
+				if (size > 1)
+				{
+					std::lock_guard<std::mutex> batchLock(batch->mtx_);
+					auto unused = std::chrono::high_resolution_clock::time_point::max();
+					for (int n = 1; n < size; n++)
+					{
+						BatchedTask batched;
+						size_t queuedCost = queuedCost_;
+						if (!popTask(slot, batched.task_, batched.tenant_, unused))
+						{
+							break;
+						}
+						// 放进缓冲的任务还没有开始执行，仍然计入taskSize_和queuedCost_，开始执行时再减去
+						batched.cost_ = queuedCost - queuedCost_;
+						queuedCost_ += batched.cost_;
+						batchedTaskSize_++;
+						batch->taskQue_.emplace_back(std::move(batched));
+					}
+				}
+
+				// 如果依然有剩余任务，继续通知其他线程执行任务
+				if (taskSize_ > batchedTaskSize_)
+				{
+					notifyWorkers();
+				}
+
+				// 任务取出后，进行通知，可以继续提交生成任务
+				notFull_.notify_all();
+			}
+		} // 把锁释放掉
+
+		if (profiler_.isEnabled())
+		{
+			Profiler::markDequeue();
+		}
+
+		// 当前线程负责指向这个任务
+		if (task)
+		{
+			runTask(task); // 执行Task
+		}
+		finishTask(tenant);
+	}
+}
+
+// 线程退出		调用者已经持有taskQueMtx_
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::exitThread(int threadid, std::unique_lock<std::mutex>& lock)
+{
+	// exit函数不持有锁执行，线程还在threads_里，析构函数会等待
+	if (workerExit_)
+	{
+		lock.unlock();
+		workerExit_(currentWorkerIndex());
+		lock.lock();
+	}
+	releaseWorkerIndex(currentWorkerIndex());
+	setCurrentWorkerIndex(-1);
+	setCurrentPool(nullptr);
+
+	threads_.erase(threadid);
+	profiler_.threadExit(threadid);
+	POOL_LOG("threadid: " << std::this_thread::get_id() << " exit!");
+	exitCond_.notify_all();
+}
+
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+bool BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::checkRunningState() const
+{
+	return isPoolRunning_;
+}
+
+// 是否有任务可以交给共享线程		fixed模式最多占用initThreadSize_个共享线程，cached模式最多threadSizeThreshHold_个
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+bool BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::hasSharedTask() const
+{
+	int limit = isCachedMode() ? threadSizeThreshHold_ : initThreadSize_;
+	return taskSize_ > 0 && runningSharedSize_ < limit;
+}
+
+// 共享线程取一个任务
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+bool BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::popSharedTask(Task& task, Tenant*& tenant)
+{
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	int limit = isCachedMode() ? threadSizeThreshHold_ : initThreadSize_;
+	if (runningSharedSize_ >= limit)
+	{
+		return false;
+	}
+
+	auto nextSteal = std::chrono::high_resolution_clock::time_point::max();
+	if (!popTask(-1, task, tenant, nextSteal))
+	{
+		return false;
+	}
+
+	runningSharedSize_++;
+	taskSize_--;
+	if (profiler_.isEnabled())
+	{
+		Profiler::markDequeue();
+	}
+	notFull_.notify_all();
+	return true;
+}
+
+// 共享线程取一个任务并执行
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+bool BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::runSharedTask()
+{
+	Task task;
+	Tenant* tenant = nullptr;
+	if (!popSharedTask(task, tenant))
+	{
+		return false;
+	}
+
+	// 执行任务时不持有taskQueMtx_
+	if (task)
+	{
+		runTask(task);
+	}
+	finishSharedTask(tenant);
+	return true;
+}
+
+// 共享线程执行完任务
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::finishSharedTask(Tenant* tenant)
+{
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	tenant->completedSize_++;
+	tenant->runningSize_--;
+	runningSharedSize_--;
+	if (!isPoolRunning_)
+	{
+		// 析构函数在等待所有任务执行完
+		exitCond_.notify_all();
+	}
+}
+
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+BasicThreadPool<QueuePolicy, IdlePolicy, SizingPolicy>::~BasicThreadPool()
+{
+#ifdef __linux__
+	// 先停止Reactor，不再产生新的完成任务，已经交给线程池的任务照常执行
+	if (reactor_ != nullptr)
+	{
+		reactor_->stop();
+	}
+#endif
+
+	// 停止定时线程，不再有等待令牌的任务放进来，还在rateLimited执行器里等待的任务被丢弃，future得到broken_promise
+	stopTimer();
+
+	isPoolRunning_ = false;
+	//notEmpty_.notify_all();
+
+	// 等待线程池里面所有线程返回 有两种状态：阻塞 & 执行任务中
+	std::unique_lock<std::mutex> lock(taskQueMtx_);
+	if (isShared_)
+	{
+		// 共享线程模式下等待所有任务执行完，再离开Scheduler
+		exitCond_.wait(lock, [&]()->bool { return taskSize_ == 0 && runningSharedSize_ == 0; });
+		lock.unlock();
+		Scheduler::instance().detach(this);
+		watchdog_.stop();
+		return;
+	}
+	notifyWorkers();
+	exitCond_.wait(lock, [&]()->bool { return threads_.size() == 0; });
+
+	// 排空任务时卡住也能报告，所以最后停止看门狗		它会获取taskQueMtx_，先释放
+	lock.unlock();
+	watchdog_.stop();
+}
+
+#undef POOL_LOG
+
+#endif
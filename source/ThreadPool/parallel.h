@@ -0,0 +1,418 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+#include "threadpool.h"
+
+/*
+在线程池上执行的并行算法		pool可以是任何策略的BasicThreadPool
+数据按块划分，每块是连续的一段元素，块内用普通的循环或者标准算法处理，编译器可以向量化
+不为每个元素创建任务：每个线程一个辅助任务，从原子计数器上领取块，调用线程自己也领取块
+线程池的任务队列满了辅助任务提交不进去时，调用线程独自完成，不会阻塞也不会失败
+在线程池的任务里调用也不会死锁
+
+example:
+std::vector<int> v = ...;
+parallelSort(pool, v.begin(), v.end());
+parallelInclusiveScan(pool, v.begin(), v.end(), v.begin());
+*/
+
+const size_t PARALLEL_BLOCK_BYTES = 64 * 1024; // 每块的目标大小，一块的数据能放进L2 cache
+const size_t PARALLEL_MIN_BLOCK = 1024; // 每块最少的元素数量
+const size_t PARALLEL_SORT_MIN = 16 * 1024; // 元素数量少于这个值时直接std::sort
+
+// 并行度：线程池的线程数量加上调用线程
+// 共享线程模式或者延迟启动时线程池还没有线程，使用CPU的核心数量
+template<typename Pool>
+size_t parallelism(Pool& pool)
+{
+	int threadSize = pool.getStats().threadSize_;
+	if (threadSize <= 0)
+	{
+		threadSize = (int)std::thread::hardware_concurrency();
+	}
+	return (size_t)std::max(threadSize, 1) + 1;
+}
+
+// 把n个元素分成块，每块大约PARALLEL_BLOCK_BYTES字节
+template<typename T>
+size_t parallelBlockCount(size_t n)
+{
+	size_t blockSize = std::max(PARALLEL_BLOCK_BYTES / sizeof(T), PARALLEL_MIN_BLOCK);
+	return (n + blockSize - 1) / blockSize;
+}
+
+// 第block块的起始下标，blockCount块平分n个元素，前n % blockCount块各多一个元素
+inline size_t parallelBlockBegin(size_t n, size_t blockCount, size_t block)
+{
+	return block * (n / blockCount) + std::min(block, n % blockCount);
+}
+
+// parallelFor的共享状态		辅助任务持有shared_ptr，调用线程返回以后才开始执行的辅助任务也能安全退出
+template<typename Func>
+struct ParallelForState
+{
+	ParallelForState(size_t blockCount, Func* body) : nextBlock_(0), doneBlock_(0), blockCount_(blockCount), body_(body)
+	{
+	}
+
+	// 领取块并执行，直到没有块可以领取
+	void run()
+	{
+		for (;;)
+		{
+			size_t block = nextBlock_.fetch_add(1);
+			if (block >= blockCount_)
+			{
+				// 领不到块时不再访问body_，调用线程可能已经返回
+				return;
+			}
+
+			try
+			{
+				(*body_)(block);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(mtx_);
+				if (!exception_)
+				{
+					exception_ = std::current_exception();
+				}
+			}
+
+			if (doneBlock_.fetch_add(1) + 1 == blockCount_)
+			{
+				std::lock_guard<std::mutex> lock(mtx_);
+				doneCond_.notify_all();
+			}
+		}
+	}
+
+	// 等待所有块执行完，有块抛出异常时重新抛出第一个异常
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(mtx_);
+		doneCond_.wait(lock, [&]()->bool { return doneBlock_ == blockCount_; });
+		if (exception_)
+		{
+			std::rethrow_exception(exception_);
+		}
+	}
+
+	std::atomic<size_t> nextBlock_; // 下一个要领取的块
+	std::atomic<size_t> doneBlock_; // 已经执行完的块数量
+	size_t blockCount_;
+	Func* body_;
+	std::exception_ptr exception_; // 第一个异常
+	std::mutex mtx_;
+	std::condition_variable doneCond_;
+};
+
+// 并行执行body(0) ... body(blockCount - 1)，全部执行完以后返回
+template<typename Pool, typename Func>
+void parallelFor(Pool& pool, size_t blockCount, Func&& body)
+{
+	if (blockCount == 0)
+	{
+		return;
+	}
+	if (blockCount == 1)
+	{
+		body(0);
+		return;
+	}
+
+	using State = ParallelForState<std::remove_reference_t<Func>>;
+	auto state = std::make_shared<State>(blockCount, &body);
+
+	// 除了调用线程，最多再用parallelism - 1个线程，任务队列满了就少用几个
+	size_t helperSize = std::min(blockCount, parallelism(pool)) - 1;
+	for (size_t i = 0; i < helperSize; i++)
+	{
+		if (!pool.tryPost([state]() { state->run(); }))
+		{
+			break;
+		}
+	}
+
+	state->run();
+	state->wait();
+}
+
+// 并行transform：out[i] = op(first[i])，返回输出的末尾
+template<typename Pool, typename RandomIt, typename OutputIt, typename UnaryOp>
+OutputIt parallelTransform(Pool& pool, RandomIt first, RandomIt last, OutputIt out, UnaryOp op)
+{
+	size_t n = (size_t)(last - first);
+	using T = typename std::iterator_traits<RandomIt>::value_type;
+	size_t blockCount = parallelBlockCount<T>(n);
+
+	parallelFor(pool, blockCount, [&](size_t block) {
+		size_t begin = parallelBlockBegin(n, blockCount, block);
+		size_t end = parallelBlockBegin(n, blockCount, block + 1);
+		std::transform(first + begin, first + end, out + begin, op);
+	});
+	return out + n;
+}
+
+// 并行inclusive scan：out[i] = first[0] op first[1] op ... op first[i]，op必须满足结合律，返回输出的末尾
+// out可以等于first，原地计算
+// 1.每块求和  2.块的和做前缀(块的数量很少，调用线程直接算)  3.每块加上前面所有块的和做scan
+template<typename Pool, typename RandomIt, typename OutputIt, typename BinaryOp = std::plus<>>
+OutputIt parallelInclusiveScan(Pool& pool, RandomIt first, RandomIt last, OutputIt out, BinaryOp op = BinaryOp())
+{
+	size_t n = (size_t)(last - first);
+	using T = typename std::iterator_traits<RandomIt>::value_type;
+	size_t blockCount = parallelBlockCount<T>(n);
+	if (blockCount <= 1)
+	{
+		return std::inclusive_scan(first, last, out, op);
+	}
+
+	// 1.每块的和，最后一块的和用不到
+	std::vector<std::optional<T>> sums(blockCount);
+	parallelFor(pool, blockCount - 1, [&](size_t block) {
+		size_t begin = parallelBlockBegin(n, blockCount, block);
+		size_t end = parallelBlockBegin(n, blockCount, block + 1);
+		T sum = first[begin];
+		for (size_t i = begin + 1; i < end; i++)
+		{
+			sum = op(std::move(sum), first[i]);
+		}
+		sums[block] = std::move(sum);
+	});
+
+	// 2.sums[block]变成前面所有块的和
+	for (size_t block = 1; block < blockCount - 1; block++)
+	{
+		sums[block] = op(*sums[block - 1], *sums[block]);
+	}
+
+	// 3.第0块直接scan，其它块从前面所有块的和开始scan
+	parallelFor(pool, blockCount, [&](size_t block) {
+		size_t begin = parallelBlockBegin(n, blockCount, block);
+		size_t end = parallelBlockBegin(n, blockCount, block + 1);
+		if (block == 0)
+		{
+			std::inclusive_scan(first + begin, first + end, out + begin, op);
+		}
+		else
+		{
+			std::inclusive_scan(first + begin, first + end, out + begin, op, *sums[block - 1]);
+		}
+	});
+	return out + n;
+}
+
+// 并行copy_if：按原来的顺序复制满足pred的元素，返回输出的末尾
+// 1.每块计算pred并记录结果、计数  2.计数做前缀得到每块的输出位置  3.每块复制
+// out不是随机访问迭代器时(比如back_inserter)，第3步由调用线程按顺序复制
+// pred每个元素只调用一次
+template<typename Pool, typename RandomIt, typename OutputIt, typename Pred>
+OutputIt parallelCopyIf(Pool& pool, RandomIt first, RandomIt last, OutputIt out, Pred pred)
+{
+	size_t n = (size_t)(last - first);
+	using T = typename std::iterator_traits<RandomIt>::value_type;
+	size_t blockCount = parallelBlockCount<T>(n);
+	if (blockCount <= 1)
+	{
+		return std::copy_if(first, last, out, pred);
+	}
+
+	std::unique_ptr<unsigned char[]> flags(new unsigned char[n]); // 不初始化，每个元素都会写
+	std::vector<size_t> offsets(blockCount + 1, 0);
+
+	// 1.计算pred
+	parallelFor(pool, blockCount, [&](size_t block) {
+		size_t begin = parallelBlockBegin(n, blockCount, block);
+		size_t end = parallelBlockBegin(n, blockCount, block + 1);
+		size_t count = 0;
+		for (size_t i = begin; i < end; i++)
+		{
+			flags[i] = pred(first[i]) ? 1 : 0;
+			count += flags[i];
+		}
+		offsets[block + 1] = count;
+	});
+
+	// 只能顺序写的输出不需要每块的位置
+	using OutputCategory = typename std::iterator_traits<OutputIt>::iterator_category;
+	if constexpr (!std::is_base_of<std::random_access_iterator_tag, OutputCategory>::value)
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			if (flags[i])
+			{
+				*out = first[i];
+				++out;
+			}
+		}
+		return out;
+	}
+	else
+	{
+		// 2.每块的输出位置
+		for (size_t block = 0; block < blockCount; block++)
+		{
+			offsets[block + 1] += offsets[block];
+		}
+
+		// 3.复制
+		parallelFor(pool, blockCount, [&](size_t block) {
+			size_t begin = parallelBlockBegin(n, blockCount, block);
+			size_t end = parallelBlockBegin(n, blockCount, block + 1);
+			OutputIt dest = out + offsets[block];
+			for (size_t i = begin; i < end; i++)
+			{
+				if (flags[i])
+				{
+					*dest = first[i];
+					++dest;
+				}
+			}
+		});
+		return out + offsets[blockCount];
+	}
+}
+
+// 归并路径		a[0, m)和b[0, n)归并结果的前d个元素里，有多少个来自a
+// 相等的元素a在前，和std::merge一致
+template<typename ItA, typename ItB, typename Compare>
+size_t mergePathSplit(ItA a, size_t m, ItB b, size_t n, size_t d, Compare& comp)
+{
+	size_t lo = d > n ? d - n : 0;
+	size_t hi = std::min(d, m);
+	while (lo < hi)
+	{
+		size_t i = lo + (hi - lo) / 2;
+		if (comp(b[d - i - 1], a[i]))
+		{
+			hi = i;
+		}
+		else
+		{
+			lo = i + 1;
+		}
+	}
+	return lo;
+}
+
+// 一轮归并：src里每两个相邻的长度为width的有序段归并到dst
+// 每对的输出按块切分，用归并路径找到每块在两个输入段里的起点，所有块并行归并
+// 先找出所有块的起点再开始移动元素，否则二分查找可能比较到已经被移走的元素
+template<typename Pool, typename SrcIt, typename DstIt, typename Compare>
+void parallelMergeRound(Pool& pool, SrcIt src, DstIt dst, size_t n, size_t width, size_t blockSize, Compare& comp)
+{
+	size_t pairSize = (n + 2 * width - 1) / (2 * width);
+	size_t blocksPerPair = (2 * width + blockSize - 1) / blockSize;
+
+	// 第index块在它那一对里的输出范围[outBegin, outEnd)，以及两个输入段
+	auto locate = [&](size_t index, size_t& pairBegin, size_t& m, size_t& k, size_t& outBegin, size_t& outEnd) {
+		pairBegin = index / blocksPerPair * 2 * width;
+		m = std::min(width, n - pairBegin); // 最后一对可能只有一段
+		k = std::min(width, n - pairBegin - m);
+		outBegin = std::min(index % blocksPerPair * blockSize, m + k);
+		outEnd = std::min(outBegin + blockSize, m + k);
+	};
+
+	// 1.每块的起点来自第一段的元素数量
+	size_t blockCount = pairSize * blocksPerPair;
+	std::vector<size_t> splits(blockCount);
+	parallelFor(pool, parallelBlockCount<size_t>(blockCount), [&](size_t part) {
+		size_t partCount = parallelBlockCount<size_t>(blockCount);
+		for (size_t index = parallelBlockBegin(blockCount, partCount, part); index < parallelBlockBegin(blockCount, partCount, part + 1); index++)
+		{
+			size_t pairBegin, m, k, outBegin, outEnd;
+			locate(index, pairBegin, m, k, outBegin, outEnd);
+			splits[index] = mergePathSplit(src + pairBegin, m, src + pairBegin + m, k, outBegin, comp);
+		}
+	});
+
+	// 2.每块归并，终点是下一块的起点
+	parallelFor(pool, blockCount, [&](size_t index) {
+		size_t pairBegin, m, k, outBegin, outEnd;
+		locate(index, pairBegin, m, k, outBegin, outEnd);
+		if (outBegin == outEnd)
+		{
+			return;
+		}
+
+		SrcIt a = src + pairBegin;
+		SrcIt b = a + m;
+		size_t i0 = splits[index];
+		size_t i1 = outEnd == m + k ? m : splits[index + 1];
+		std::merge(std::make_move_iterator(a + i0), std::make_move_iterator(a + i1),
+			std::make_move_iterator(b + (outBegin - i0)), std::make_move_iterator(b + (outEnd - i1)),
+			dst + pairBegin + outBegin, comp);
+	});
+}
+
+// 并行排序：每个线程对一段std::sort，再逐轮并行归并
+// 不稳定，和std::sort一样；需要和输入等长的临时缓冲区，元素类型必须可以默认构造
+template<typename Pool, typename RandomIt, typename Compare = std::less<>>
+void parallelSort(Pool& pool, RandomIt first, RandomIt last, Compare comp = Compare())
+{
+	size_t n = (size_t)(last - first);
+	if (n < PARALLEL_SORT_MIN)
+	{
+		std::sort(first, last, comp);
+		return;
+	}
+
+	using T = typename std::iterator_traits<RandomIt>::value_type;
+	size_t chunkCount = std::min(parallelism(pool), n / (PARALLEL_SORT_MIN / 2));
+	size_t width = (n + chunkCount - 1) / chunkCount;
+	chunkCount = (n + width - 1) / width;
+
+	// 1.每段排序
+	parallelFor(pool, chunkCount, [&](size_t chunk) {
+		std::sort(first + chunk * width, first + std::min((chunk + 1) * width, n), comp);
+	});
+	if (chunkCount == 1)
+	{
+		return;
+	}
+
+	// 2.逐轮归并，在原数组和缓冲区之间来回
+	std::unique_ptr<T[]> buffer(new T[n]);
+	size_t blockSize = std::max(PARALLEL_BLOCK_BYTES / sizeof(T), PARALLEL_MIN_BLOCK);
+	bool isInBuffer = false;
+	for (; width < n; width *= 2)
+	{
+		if (isInBuffer)
+		{
+			parallelMergeRound(pool, buffer.get(), first, n, width, blockSize, comp);
+		}
+		else
+		{
+			parallelMergeRound(pool, first, buffer.get(), n, width, blockSize, comp);
+		}
+		isInBuffer = !isInBuffer;
+	}
+
+	// 3.结果在缓冲区里时搬回原数组
+	if (isInBuffer)
+	{
+		size_t blockCount = (n + blockSize - 1) / blockSize;
+		parallelFor(pool, blockCount, [&](size_t block) {
+			T* begin = buffer.get() + block * blockSize;
+			T* end = buffer.get() + std::min((block + 1) * blockSize, n);
+			std::move(begin, end, first + block * blockSize);
+		});
+	}
+}
+
+#endif
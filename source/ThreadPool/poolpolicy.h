@@ -0,0 +1,230 @@
+#ifndef POOLPOLICY_H
+#define POOLPOLICY_H
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+/*
+BasicThreadPool的策略类型
+队列、空闲线程的等待方式和线程数量策略由模板参数决定，ThreadPool是默认策略的BasicThreadPool
+编译期确定的策略没有运行时的判断，比如FixedSize的线程池里没有cached模式的分支
+
+QueuePolicy		租户的任务队列，提供模板Queue<T>，所有方法在持有线程池的锁时调用
+				bool push(T&& task)		队列满时返回false，task保持不变
+				bool pop(T& task)		队列空时返回false
+				bool empty() const
+				bool full() const
+				static constexpr bool IS_BOUNDED	是否有容量上限，有上限时提交任务等待队列不满
+IdlePolicy		空闲线程的等待方式，每个等待的线程一个对象
+				template<typename Pred> void wait(std::unique_lock<std::mutex>& lock, std::condition_variable& cond, Pred ready)
+				template<typename Pred, typename Time> bool waitUntil(lock, cond, Time time, Pred ready)	超时返回false
+				可以有成员const std::atomic_bool* hint_，线程池把这个线程被唤醒的提示设置给它，不加锁读取
+SizingPolicy	线程数量策略
+				static constexpr bool IS_RUNTIME			是否由setMode在运行时决定fixed还是cached
+				static constexpr bool IS_CACHED				是否按任务数量增加线程，IS_RUNTIME时不使用
+				static constexpr int MAX_THREAD_SIZE		线程数量上限的初始值(包括补偿线程)，setThreadSizeMaxThreshHold可以修改
+				static constexpr int MAX_IDLE_SECONDS		cached模式多余线程的最长空闲时间
+
+example:
+using LowLatencyPool = BasicThreadPool<RingQueue<1024>, SpinThenBlock<2000>, FixedSize>;
+LowLatencyPool pool;
+pool.start(4);
+std::future<int> result = pool.submitTask([](int a, int b) { return a + b; }, 1, 2);
+auto strand = pool.makeStrand(); // Strand、限流执行器、异步IO、ShmServer和parallel.h的算法不依赖策略
+*/
+
+//---------------------------队列策略-------------------
+// 无界FIFO队列		上限由setTaskQueMaxThreshHold设置
+struct FifoQueue
+{
+	static constexpr bool IS_BOUNDED = false;
+
+	template<typename T>
+	class Queue
+	{
+	public:
+		bool push(T&& task)
+		{
+			taskQue_.emplace_back(std::move(task));
+			return true;
+		}
+
+		bool pop(T& task)
+		{
+			if (taskQue_.empty())
+			{
+				return false;
+			}
+			task = std::move(taskQue_.front());
+			taskQue_.pop_front();
+			return true;
+		}
+
+		bool empty() const
+		{
+			return taskQue_.empty();
+		}
+
+		bool full() const
+		{
+			return false;
+		}
+
+	private:
+		std::deque<T> taskQue_;
+	};
+};
+
+// 固定容量的环形队列		容量是2的幂，存储在租户对象里，入队出队不分配内存
+// 租户的队列满时提交任务和任务数量超过上限一样等待
+template<size_t Capacity>
+struct RingQueue
+{
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "RingQueue capacity must be a power of 2");
+
+	static constexpr bool IS_BOUNDED = true;
+
+	template<typename T>
+	class Queue
+	{
+	public:
+		bool push(T&& task)
+		{
+			if (full())
+			{
+				return false;
+			}
+			slots_[tail_ & (Capacity - 1)] = std::move(task);
+			tail_++;
+			return true;
+		}
+
+		bool pop(T& task)
+		{
+			if (empty())
+			{
+				return false;
+			}
+			task = std::move(slots_[head_ & (Capacity - 1)]);
+			head_++;
+			return true;
+		}
+
+		bool empty() const
+		{
+			return head_ == tail_;
+		}
+
+		bool full() const
+		{
+			return tail_ - head_ == Capacity;
+		}
+
+	private:
+		std::array<T, Capacity> slots_;
+		size_t head_ = 0; // 下一个出队的位置
+		size_t tail_ = 0; // 下一个入队的位置
+	};
+};
+
+//---------------------------等待策略-------------------
+// 直接在条件变量上阻塞
+struct BlockingWait
+{
+	template<typename Pred>
+	void wait(std::unique_lock<std::mutex>& lock, std::condition_variable& cond, Pred ready)
+	{
+		cond.wait(lock, ready);
+	}
+
+	template<typename Pred, typename Time>
+	bool waitUntil(std::unique_lock<std::mutex>& lock, std::condition_variable& cond, Time time, Pred ready)
+	{
+		return cond.wait_until(lock, time, ready);
+	}
+};
+
+// 先释放锁自旋Spins次，任务很快到来时不需要经过条件变量唤醒，之后再阻塞
+// 自旋期间占用CPU，线程数量不要超过空闲的核数
+template<int Spins>
+struct SpinThenBlock
+{
+	template<typename Pred>
+	void wait(std::unique_lock<std::mutex>& lock, std::condition_variable& cond, Pred ready)
+	{
+		if (!spin(lock, ready))
+		{
+			cond.wait(lock, ready);
+		}
+	}
+
+	template<typename Pred, typename Time>
+	bool waitUntil(std::unique_lock<std::mutex>& lock, std::condition_variable& cond, Time time, Pred ready)
+	{
+		return spin(lock, ready) || cond.wait_until(lock, time, ready);
+	}
+
+private:
+	// 自旋期间不持有锁，每次只检查一下唤醒提示
+	template<typename Pred>
+	bool spin(std::unique_lock<std::mutex>& lock, Pred& ready)
+	{
+		if (ready())
+		{
+			return true;
+		}
+		lock.unlock();
+		for (int i = 0; i < Spins && !hint_->load(std::memory_order_relaxed); i++)
+		{
+			std::this_thread::yield();
+		}
+		lock.lock();
+		return ready();
+	}
+
+public:
+	const std::atomic_bool* hint_ = nullptr; // 被唤醒的提示，由线程池设置
+};
+
+//---------------------------线程数量策略-------------------
+// 运行时由setMode决定，默认fixed模式
+struct RuntimeSize
+{
+	static constexpr bool IS_RUNTIME = true;
+	static constexpr bool IS_CACHED = false;
+	static constexpr int MAX_THREAD_SIZE = 1024;
+	static constexpr int MAX_IDLE_SECONDS = 60;
+};
+
+// 线程数量固定为start的参数，阻塞区的补偿线程仍然受MAX_THREAD_SIZE限制
+struct FixedSize
+{
+	static constexpr bool IS_RUNTIME = false;
+	static constexpr bool IS_CACHED = false;
+	static constexpr int MAX_THREAD_SIZE = 1024;
+	static constexpr int MAX_IDLE_SECONDS = 60;
+};
+
+// 任务多于空闲线程时增加线程，最多MaxThreads个，空闲超过IdleSeconds的多余线程退出
+template<int MaxThreads = 1024, int IdleSeconds = 60>
+struct CachedSize
+{
+	static constexpr bool IS_RUNTIME = false;
+	static constexpr bool IS_CACHED = true;
+	static constexpr int MAX_THREAD_SIZE = MaxThreads;
+	static constexpr int MAX_IDLE_SECONDS = IdleSeconds;
+};
+
+// 线程池类型		定义在threadpool.h，成员函数的实现在basicthreadpool.h
+template<typename QueuePolicy = FifoQueue, typename IdlePolicy = BlockingWait, typename SizingPolicy = RuntimeSize>
+class BasicThreadPool;
+
+// 默认策略的线程池：无界队列，条件变量等待，运行时切换fixed和cached模式
+using ThreadPool = BasicThreadPool<>;
+
+#endif
@@ -0,0 +1,266 @@
+#include "profiler.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <set>
+
+// 区分不同Profiler的计数器
+static std::atomic<uint64_t> generateId(0);
+
+// 当前线程在线程池里的ID，不是线程池的线程时为-1
+static thread_local int currentThreadId = -1;
+// 当前线程最近一次取出任务的时间
+static thread_local std::chrono::steady_clock::time_point currentDequeueTime;
+
+// 输出JSON字符串，转义引号、反斜杠和控制字符
+static void writeJsonString(std::ostream& out, const char* str)
+{
+	out << '"';
+	for (const char* p = str; *p != '\0'; p++)
+	{
+		unsigned char c = (unsigned char)*p;
+		if (c == '"' || c == '\\')
+		{
+			out << '\\' << (char)c;
+		}
+		else if (c < 0x20)
+		{
+			const char* hex = "0123456789abcdef";
+			out << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+		}
+		else
+		{
+			out << (char)c;
+		}
+	}
+	out << '"';
+}
+
+// 纳秒转换成Trace Event使用的微秒
+static double toMicros(int64_t nanos)
+{
+	return nanos / 1000.0;
+}
+
+Profiler::Profiler() : id_(++generateId), isEnabled_(false), origin_(0)
+{
+
+}
+
+Profiler::~Profiler()
+{
+	// 线程的缓存里还有这个Profiler的缓冲区，让线程下次注册时删除
+	std::lock_guard<std::mutex> lock(mtx_);
+	for (auto& buffer : buffers_)
+	{
+		buffer->isDetached_ = true;
+	}
+}
+
+Profiler::BufferCache::~BufferCache()
+{
+	for (auto& pair : buffers_)
+	{
+		pair.second->isExited_ = true;
+	}
+}
+
+void Profiler::start()
+{
+	std::lock_guard<std::mutex> lock(mtx_);
+	pruneBuffers();
+	for (auto& buffer : buffers_)
+	{
+		std::lock_guard<std::mutex> bufferLock(buffer->mtx_);
+		buffer->taskRecords_.clear();
+	}
+	taskRecords_.clear();
+	threadRecords_.clear();
+	origin_ = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+	isEnabled_ = true;
+}
+
+void Profiler::stop()
+{
+	isEnabled_ = false;
+}
+
+Task Profiler::wrap(Task task, const char* label)
+{
+	Clock::time_point submitTime = Clock::now();
+	return [this, task = std::move(task), label, submitTime]() mutable {
+		// 任务抛出异常时也记录结束时间
+		struct Recorder
+		{
+			~Recorder()
+			{
+				TaskRecord rec;
+				rec.label_ = label_;
+				rec.threadId_ = currentThreadId;
+				rec.submitTime_ = profiler_->toNanos(submitTime_);
+				rec.dequeueTime_ = profiler_->toNanos(currentDequeueTime);
+				rec.startTime_ = profiler_->toNanos(startTime_);
+				rec.endTime_ = profiler_->toNanos(Clock::now());
+				profiler_->record(rec);
+			}
+
+			Profiler* profiler_;
+			const char* label_;
+			Clock::time_point submitTime_;
+			Clock::time_point startTime_;
+		} recorder{ this, label, submitTime, Clock::now() };
+
+		task();
+	};
+}
+
+void Profiler::setCurrentThread(int threadId)
+{
+	currentThreadId = threadId;
+}
+
+void Profiler::markDequeue()
+{
+	currentDequeueTime = Clock::now();
+}
+
+void Profiler::threadSpawn(int threadId)
+{
+	if (!isEnabled_)
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mtx_);
+	threadRecords_.push_back({ threadId, true, toNanos(Clock::now()) });
+}
+
+void Profiler::threadExit(int threadId)
+{
+	if (!isEnabled_)
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mtx_);
+	threadRecords_.push_back({ threadId, false, toNanos(Clock::now()) });
+}
+
+int64_t Profiler::toNanos(Clock::time_point time) const
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count() - origin_;
+}
+
+Profiler::TaskBuffer* Profiler::currentBuffer()
+{
+	static thread_local BufferCache cache;
+	auto it = cache.buffers_.find(id_);
+	if (it != cache.buffers_.end())
+	{
+		return it->second.get();
+	}
+
+	// 顺便删除已经析构的Profiler的缓冲区
+	for (auto iter = cache.buffers_.begin(); iter != cache.buffers_.end();)
+	{
+		iter = iter->second->isDetached_ ? cache.buffers_.erase(iter) : std::next(iter);
+	}
+
+	auto buffer = std::make_shared<TaskBuffer>();
+	cache.buffers_.emplace(id_, buffer);
+
+	std::lock_guard<std::mutex> lock(mtx_);
+	pruneBuffers();
+	buffers_.push_back(buffer);
+	return buffer.get();
+}
+
+// 把线程已经退出的缓冲区合并到taskRecords_后删除，cached模式下线程反复创建回收时缓冲区不会一直增加
+void Profiler::pruneBuffers()
+{
+	auto it = std::partition(buffers_.begin(), buffers_.end(),
+		[](const std::shared_ptr<TaskBuffer>& buffer) { return !buffer->isExited_; });
+	for (auto iter = it; iter != buffers_.end(); ++iter)
+	{
+		std::lock_guard<std::mutex> bufferLock((*iter)->mtx_);
+		taskRecords_.insert(taskRecords_.end(), (*iter)->taskRecords_.begin(), (*iter)->taskRecords_.end());
+	}
+	buffers_.erase(it, buffers_.end());
+}
+
+// 写到当前线程自己的缓冲区，只在导出和重新开始时和其他线程竞争
+void Profiler::record(const TaskRecord& rec)
+{
+	if (!isEnabled_)
+	{
+		return;
+	}
+	TaskBuffer* buffer = currentBuffer();
+	std::lock_guard<std::mutex> lock(buffer->mtx_);
+	buffer->taskRecords_.push_back(rec);
+}
+
+void Profiler::exportTrace(std::ostream& out) const
+{
+	std::lock_guard<std::mutex> lock(mtx_);
+
+	// 合并所有线程的记录，按开始时间排序
+	std::vector<TaskRecord> taskRecords(taskRecords_);
+	for (auto& buffer : buffers_)
+	{
+		std::lock_guard<std::mutex> bufferLock(buffer->mtx_);
+		taskRecords.insert(taskRecords.end(), buffer->taskRecords_.begin(), buffer->taskRecords_.end());
+	}
+	std::sort(taskRecords.begin(), taskRecords.end(),
+		[](const TaskRecord& a, const TaskRecord& b) { return a.startTime_ < b.startTime_; });
+
+	out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"ThreadPool\"}}";
+
+	// 线程名称
+	std::set<int> threadIds;
+	for (const TaskRecord& rec : taskRecords)
+	{
+		threadIds.insert(rec.threadId_);
+	}
+	for (const ThreadRecord& rec : threadRecords_)
+	{
+		threadIds.insert(rec.threadId_);
+	}
+	for (int threadId : threadIds)
+	{
+		out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadId
+			<< ",\"args\":{\"name\":\"worker " << threadId << "\"}}";
+	}
+
+	// 每个任务：执行区间画在执行它的线程上，排队区间用异步事件画在单独的轨道上
+	int64_t id = 0;
+	for (const TaskRecord& rec : taskRecords)
+	{
+		const char* label = rec.label_ != nullptr ? rec.label_ : "task";
+
+		out << ",\n{\"name\":";
+		writeJsonString(out, label);
+		out << ",\"cat\":\"task\",\"ph\":\"X\",\"pid\":1,\"tid\":" << rec.threadId_
+			<< ",\"ts\":" << toMicros(rec.startTime_)
+			<< ",\"dur\":" << toMicros(rec.endTime_ - rec.startTime_)
+			<< ",\"args\":{\"queue_us\":" << toMicros(rec.dequeueTime_ - rec.submitTime_)
+			<< ",\"dispatch_us\":" << toMicros(rec.startTime_ - rec.dequeueTime_) << "}}";
+
+		out << ",\n{\"name\":";
+		writeJsonString(out, label);
+		out << ",\"cat\":\"queue\",\"ph\":\"b\",\"id\":" << id << ",\"pid\":1,\"ts\":" << toMicros(rec.submitTime_) << "}";
+		out << ",\n{\"name\":";
+		writeJsonString(out, label);
+		out << ",\"cat\":\"queue\",\"ph\":\"e\",\"id\":" << id << ",\"pid\":1,\"ts\":" << toMicros(rec.dequeueTime_) << "}";
+		id++;
+	}
+
+	// 线程的创建和回收
+	for (const ThreadRecord& rec : threadRecords_)
+	{
+		out << ",\n{\"name\":\"" << (rec.isSpawn_ ? "thread spawn" : "thread exit")
+			<< "\",\"cat\":\"thread\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" << rec.threadId_
+			<< ",\"ts\":" << toMicros(rec.time_) << "}";
+	}
+
+	out << "\n]}\n";
+}
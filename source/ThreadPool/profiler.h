@@ -0,0 +1,116 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+class Task;
+
+/*
+Profiler 记录线程池每个任务的时间线
+任务：提交时间、出队时间、在哪个线程上开始和结束执行、任务名称
+线程：cached模式下线程的创建和回收
+导出Chrome Trace Event格式的JSON，可以用Perfetto或者chrome://tracing打开
+任务记录写到执行线程自己的缓冲区，不同线程之间不竞争同一把锁，导出时再合并
+*/
+class Profiler
+{
+public:
+	Profiler();
+	~Profiler();
+
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	// 清空之前的记录，开始记录
+	void start();
+
+	// 停止记录，已经记录的数据保留到下一次start
+	void stop();
+
+	bool isEnabled() const
+	{
+		return isEnabled_;
+	}
+
+	// 包装任务：记录提交时间，执行时记录开始和结束时间
+	Task wrap(Task task, const char* label);
+
+	// 线程池的线程调用：记录当前线程ID和任务出队时间
+	static void setCurrentThread(int threadId);
+	static void markDequeue();
+
+	// 记录线程的创建和回收
+	void threadSpawn(int threadId);
+	void threadExit(int threadId);
+
+	// 导出Chrome Trace Event格式的JSON
+	void exportTrace(std::ostream& out) const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	// 一个任务的记录，时间都是相对于origin_的纳秒数
+	struct TaskRecord
+	{
+		const char* label_;
+		int threadId_;
+		int64_t submitTime_;
+		int64_t dequeueTime_;
+		int64_t startTime_;
+		int64_t endTime_;
+	};
+
+	// 一次线程创建或者回收的记录
+	struct ThreadRecord
+	{
+		int threadId_;
+		bool isSpawn_;
+		int64_t time_;
+	};
+
+	// 一个线程的任务记录		只有这个线程追加，start和exportTrace读写，锁基本没有竞争
+	struct TaskBuffer
+	{
+		std::vector<TaskRecord> taskRecords_;
+		std::mutex mtx_; // 保护taskRecords_
+		std::atomic_bool isExited_{ false }; // 线程已经退出，Profiler把记录合并后删除这个缓冲区
+		std::atomic_bool isDetached_{ false }; // Profiler已经析构，线程删除这个缓冲区
+	};
+
+	// 线程局部的缓冲区缓存		一个线程可能执行多个线程池的任务(共享线程)，每个Profiler一个缓冲区
+	// 线程退出时析构，标记它的缓冲区已经退出
+	struct BufferCache
+	{
+		~BufferCache();
+
+		std::unordered_map<uint64_t, std::shared_ptr<TaskBuffer>> buffers_; // Profiler的id => 缓冲区
+	};
+
+	int64_t toNanos(Clock::time_point time) const;
+
+	// 当前线程在这个Profiler上的缓冲区，第一次调用时注册
+	TaskBuffer* currentBuffer();
+
+	// 把线程已经退出的缓冲区合并到taskRecords_后删除		调用者已经持有mtx_
+	void pruneBuffers();
+
+	void record(const TaskRecord& rec);
+
+private:
+	const uint64_t id_; // 区分不同的Profiler，线程局部的缓冲区缓存用
+	std::atomic_bool isEnabled_;
+	std::atomic<int64_t> origin_; // start的时间(纳秒)，导出的时间戳从0开始
+	std::vector<std::shared_ptr<TaskBuffer>> buffers_; // 所有线程的缓冲区
+	std::vector<TaskRecord> taskRecords_; // 已经退出的线程留下的任务记录
+	std::vector<ThreadRecord> threadRecords_;
+	mutable std::mutex mtx_; // 保护上面的成员
+};
+
+#endif
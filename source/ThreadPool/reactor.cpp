@@ -0,0 +1,484 @@
+#include "reactor.h"
+
+#ifdef __linux__
+
+#include "threadpool.h"
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+
+const unsigned IO_URING_ENTRIES = 256; // io_uring提交队列的长度
+const int EPOLL_MAX_EVENTS = 64; // 每次epoll_wait最多返回的事件数量
+
+IoRequest::~IoRequest()
+{
+	// 请求被丢弃时先析构promise，future得到broken_promise之后再通知，whenAll拿到的future都已经就绪
+	{
+		std::promise<ssize_t> promise(std::move(promise_));
+	}
+	if (completion_ != nullptr)
+	{
+		completion_->complete();
+	}
+}
+
+Reactor::Reactor(ThreadPoolBase& pool, bool useIoUring)
+	: pool_(pool), isStopped_(false)
+	, ringFd_(-1), sqEntries_(0), cqEntries_(0)
+	, sqHead_(nullptr), sqTail_(nullptr), sqMask_(nullptr), sqArray_(nullptr)
+	, cqHead_(nullptr), cqTail_(nullptr), cqMask_(nullptr)
+	, sqRing_(MAP_FAILED), sqRingSize_(0), cqRing_(MAP_FAILED), cqRingSize_(0)
+	, sqes_(MAP_FAILED), sqesSize_(0), cqes_(nullptr)
+	, epollFd_(-1), wakeFd_(-1)
+{
+	if (useIoUring && setupIoUring())
+	{
+		thread_ = std::thread(&Reactor::ioUringLoop, this);
+		return;
+	}
+
+	// 不支持io_uring，使用epoll
+	epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+	wakeFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	epoll_event ev{};
+	ev.events = EPOLLIN;
+	ev.data.fd = wakeFd_;
+	epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &ev);
+	thread_ = std::thread(&Reactor::epollLoop, this);
+}
+
+Reactor::~Reactor()
+{
+	stop();
+
+	if (ringFd_ >= 0)
+	{
+		// 关闭io_uring会取消还没有完成的请求
+		if (sqes_ != MAP_FAILED)
+		{
+			munmap(sqes_, sqesSize_);
+		}
+		if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_)
+		{
+			munmap(cqRing_, cqRingSize_);
+		}
+		if (sqRing_ != MAP_FAILED)
+		{
+			munmap(sqRing_, sqRingSize_);
+		}
+		close(ringFd_);
+
+		// io_uring已经关闭，不会再写请求的缓冲区，回收没有完成的请求
+		for (IoRequest* req : inflight_)
+		{
+			delete req;
+		}
+		inflight_.clear();
+	}
+	if (epollFd_ >= 0)
+	{
+		close(epollFd_);
+		close(wakeFd_);
+	}
+}
+
+void Reactor::stop()
+{
+	{
+		std::lock_guard<std::mutex> sqLock(sqMtx_);
+		std::lock_guard<std::mutex> waitLock(waitQueMtx_);
+		if (isStopped_)
+		{
+			return;
+		}
+		isStopped_ = true;
+	}
+
+	if (ringFd_ >= 0)
+	{
+		// 提交一个user_data为0的NOP，Reactor线程收割到它就退出
+		std::lock_guard<std::mutex> lock(sqMtx_);
+		unsigned tail = *sqTail_;
+		unsigned index = tail & *sqMask_;
+		io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes_) + index;
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_NOP;
+		sqe->user_data = 0;
+		sqArray_[index] = index;
+		__atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+		syscall(__NR_io_uring_enter, ringFd_, 1, 0, 0, nullptr, 0);
+	}
+	else
+	{
+		uint64_t one = 1;
+		ssize_t n = write(wakeFd_, &one, sizeof(one));
+		(void)n;
+	}
+	thread_.join();
+
+	// 还在等待fd就绪的请求直接丢弃
+	std::lock_guard<std::mutex> lock(waitQueMtx_);
+	// 正在读写的请求属于线程池的任务，由任务自己回收
+	for (auto& item : waitQue_)
+	{
+		for (IoRequest* req : item.second.readQue_)
+		{
+			delete req;
+		}
+		for (IoRequest* req : item.second.writeQue_)
+		{
+			delete req;
+		}
+	}
+	waitQue_.clear();
+}
+
+void Reactor::submit(std::unique_ptr<IoRequest> req)
+{
+	IoRequest* raw = req.release();
+	if (ringFd_ >= 0)
+	{
+		if (!submitIoUring(raw))
+		{
+			// io_uring里的请求太多，退回到阻塞区里执行
+			submitBlocking(raw);
+		}
+		return;
+	}
+
+	if (!submitEpoll(raw))
+	{
+		submitBlocking(raw);
+	}
+}
+
+//---------------------------io_uring-------------------
+bool Reactor::setupIoUring()
+{
+	io_uring_params params{};
+	int fd = (int)syscall(__NR_io_uring_setup, IO_URING_ENTRIES, &params);
+	if (fd < 0)
+	{
+		return false;
+	}
+	// 需要IORING_OP_READ/WRITE和使用文件当前位置的支持(5.6以上内核)
+	if (!(params.features & IORING_FEAT_RW_CUR_POS))
+	{
+		close(fd);
+		return false;
+	}
+	ringFd_ = fd;
+	sqEntries_ = params.sq_entries;
+	cqEntries_ = params.cq_entries;
+
+	sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+	}
+
+	sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+	if (sqRing_ == MAP_FAILED)
+	{
+		return false;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		cqRing_ = sqRing_;
+	}
+	else
+	{
+		cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+		if (cqRing_ == MAP_FAILED)
+		{
+			return false;
+		}
+	}
+	sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+	sqes_ = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+	if (sqes_ == MAP_FAILED)
+	{
+		return false;
+	}
+
+	char* sq = static_cast<char*>(sqRing_);
+	sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+	sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+	sqMask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+	sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+	char* cq = static_cast<char*>(cqRing_);
+	cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+	cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+	cqMask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+	cqes_ = cq + params.cq_off.cqes;
+	return true;
+}
+
+bool Reactor::submitIoUring(IoRequest* req)
+{
+	std::lock_guard<std::mutex> lock(sqMtx_);
+	if (isStopped_)
+	{
+		delete req;
+		return true;
+	}
+
+	// 留一个位置给stop()的NOP
+	unsigned tail = *sqTail_;
+	unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+	if (tail - head >= sqEntries_ - 1 || inflight_.size() >= cqEntries_ - 1)
+	{
+		return false;
+	}
+
+	unsigned index = tail & *sqMask_;
+	io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes_) + index;
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = req->op_ == IoRequest::READ ? IORING_OP_READ : IORING_OP_WRITE;
+	sqe->fd = req->fd_;
+	sqe->addr = reinterpret_cast<uint64_t>(req->buf_);
+	sqe->len = (unsigned)req->len_;
+	sqe->off = req->off_ < 0 ? (uint64_t)-1 : (uint64_t)req->off_; // -1 表示使用文件当前位置
+	sqe->user_data = reinterpret_cast<uint64_t>(req);
+	sqArray_[index] = index;
+	__atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+	inflight_.emplace(req);
+
+	syscall(__NR_io_uring_enter, ringFd_, 1, 0, 0, nullptr, 0);
+	return true;
+}
+
+void Reactor::ioUringLoop()
+{
+	for (;;)
+	{
+		int ret = (int)syscall(__NR_io_uring_enter, ringFd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+		if (ret < 0 && errno != EINTR)
+		{
+			return;
+		}
+
+		// 收割完成队列
+		unsigned head = *cqHead_;
+		unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+		bool isExit = false;
+		for (; head != tail; head++)
+		{
+			io_uring_cqe* cqe = static_cast<io_uring_cqe*>(cqes_) + (head & *cqMask_);
+			if (cqe->user_data == 0)
+			{
+				isExit = true;
+				continue;
+			}
+
+			IoRequest* req = reinterpret_cast<IoRequest*>(cqe->user_data);
+			{
+				std::lock_guard<std::mutex> lock(sqMtx_);
+				inflight_.erase(req);
+			}
+			complete(req, cqe->res);
+		}
+		__atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+
+		if (isExit)
+		{
+			// 剩下的请求在析构关闭io_uring之后回收
+			return;
+		}
+	}
+}
+
+//---------------------------epoll-------------------
+bool Reactor::submitEpoll(IoRequest* req)
+{
+	std::lock_guard<std::mutex> lock(waitQueMtx_);
+	if (isStopped_)
+	{
+		delete req;
+		return true;
+	}
+
+	auto it = waitQue_.find(req->fd_);
+	if (it != waitQue_.end())
+	{
+		// 这个fd上已经有请求，同一个方向按顺序排队，另一个方向可能需要加上等待的事件
+		FdQueue& queue = it->second;
+		(req->op_ == IoRequest::READ ? queue.readQue_ : queue.writeQue_).emplace_back(req);
+		arm(req->fd_, queue);
+		return true;
+	}
+
+	epoll_event ev{};
+	ev.events = (req->op_ == IoRequest::READ ? EPOLLIN : EPOLLOUT) | EPOLLONESHOT;
+	ev.data.fd = req->fd_;
+	if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, req->fd_, &ev) < 0)
+	{
+		// 普通文件不支持epoll(EPERM)
+		return false;
+	}
+	FdQueue& queue = waitQue_[req->fd_];
+	(req->op_ == IoRequest::READ ? queue.readQue_ : queue.writeQue_).emplace_back(req);
+	return true;
+}
+
+void Reactor::arm(int fd, FdQueue& queue)
+{
+	if (queue.readQue_.empty() && queue.writeQue_.empty() && !queue.isReadBusy_ && !queue.isWriteBusy_)
+	{
+		epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+		waitQue_.erase(fd);
+		return;
+	}
+
+	// EPOLLONESHOT：一次事件之后整个fd停止等待，两个方向都要重新注册
+	epoll_event ev{};
+	ev.events = 0;
+	if (!queue.readQue_.empty() && !queue.isReadBusy_)
+	{
+		ev.events |= EPOLLIN;
+	}
+	if (!queue.writeQue_.empty() && !queue.isWriteBusy_)
+	{
+		ev.events |= EPOLLOUT;
+	}
+	if (ev.events == 0)
+	{
+		// 没有方向需要等待，fd在上一次事件之后已经停止等待，不注册
+		// 否则EPOLLERR、EPOLLHUP总是会报告，挂断的fd上会一直收到事件
+		return;
+	}
+	ev.events |= EPOLLONESHOT;
+	ev.data.fd = fd;
+	epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void Reactor::rearm(int fd, IoRequest::Op op)
+{
+	std::lock_guard<std::mutex> lock(waitQueMtx_);
+	auto it = waitQue_.find(fd);
+	if (it == waitQue_.end())
+	{
+		return;
+	}
+
+	(op == IoRequest::READ ? it->second.isReadBusy_ : it->second.isWriteBusy_) = false;
+	arm(fd, it->second);
+}
+
+void Reactor::epollLoop()
+{
+	epoll_event events[EPOLL_MAX_EVENTS];
+	for (;;)
+	{
+		int n = epoll_wait(epollFd_, events, EPOLL_MAX_EVENTS, -1);
+		if (n < 0 && errno != EINTR)
+		{
+			return;
+		}
+
+		for (int i = 0; i < n; i++)
+		{
+			if (events[i].data.fd == wakeFd_)
+			{
+				return;
+			}
+
+			// fd就绪了，取出就绪方向队头的请求交给线程池的线程读写，出错或者挂断时两个方向都去读写，拿到错误码
+			// 读写完成之后再rearm这个方向，同一个方向的请求按顺序一个一个执行，另一个方向立即重新等待
+			int fd = events[i].data.fd;
+			uint32_t ready = events[i].events;
+			IoRequest* reqs[2] = { nullptr, nullptr };
+			{
+				std::lock_guard<std::mutex> lock(waitQueMtx_);
+				auto it = waitQue_.find(fd);
+				if (it == waitQue_.end())
+				{
+					continue;
+				}
+
+				FdQueue& queue = it->second;
+				if ((ready & (EPOLLIN | EPOLLERR | EPOLLHUP)) && !queue.readQue_.empty() && !queue.isReadBusy_)
+				{
+					reqs[0] = queue.readQue_.front();
+					queue.readQue_.pop_front();
+					queue.isReadBusy_ = true;
+				}
+				if ((ready & (EPOLLOUT | EPOLLERR | EPOLLHUP)) && !queue.writeQue_.empty() && !queue.isWriteBusy_)
+				{
+					reqs[1] = queue.writeQue_.front();
+					queue.writeQue_.pop_front();
+					queue.isWriteBusy_ = true;
+				}
+				arm(fd, queue);
+			}
+
+			for (IoRequest* req : reqs)
+			{
+				if (req == nullptr)
+				{
+					continue;
+				}
+				pool_.scheduleTask([this, req]() {
+					ssize_t res;
+					{
+						// 阻塞模式的fd写入大块数据时，就绪之后依然可能阻塞
+						auto guard = pool_.blockingSection();
+						res = doIo(req);
+					}
+					// 先rearm再设置结果，调用者拿到结果之后可能马上关闭fd
+					rearm(req->fd_, req->op_);
+					req->promise_.set_value(res);
+					delete req;
+				}, TaskOption());
+			}
+		}
+	}
+}
+
+//---------------------------阻塞区-------------------
+void Reactor::submitBlocking(IoRequest* req)
+{
+	pool_.scheduleTask([this, req]() {
+		ssize_t res;
+		{
+			auto guard = pool_.blockingSection();
+			res = doIo(req);
+		}
+		req->promise_.set_value(res);
+		delete req;
+	}, TaskOption());
+}
+
+ssize_t Reactor::doIo(IoRequest* req)
+{
+	ssize_t res;
+	if (req->op_ == IoRequest::READ)
+	{
+		res = req->off_ < 0 ? read(req->fd_, req->buf_, req->len_) : pread(req->fd_, req->buf_, req->len_, req->off_);
+	}
+	else
+	{
+		res = req->off_ < 0 ? write(req->fd_, req->buf_, req->len_) : pwrite(req->fd_, req->buf_, req->len_, req->off_);
+	}
+	return res < 0 ? -errno : res;
+}
+
+void Reactor::complete(IoRequest* req, ssize_t res)
+{
+	// 完成事件交给线程池的线程设置结果
+	TaskOption option;
+	option.label_ = "io completion";
+	pool_.scheduleTask([req, res]() {
+		req->promise_.set_value(res);
+		delete req;
+	}, option);
+}
+
+#endif // __linux__
@@ -0,0 +1,132 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#ifdef __linux__
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <sys/types.h>
+
+class TaskCompletion;
+class ThreadPoolBase;
+
+// 一个异步IO请求
+struct IoRequest
+{
+	enum Op { READ, WRITE };
+
+	// 设置结果或者丢弃请求都会析构，在这里通知completion_
+	~IoRequest();
+
+	Op op_; // 读还是写
+	int fd_;
+	void* buf_;
+	size_t len_;
+	off_t off_; // 小于0表示使用文件当前位置
+	std::promise<ssize_t> promise_; // 完成时设置读写的字节数，失败时设置-errno
+	std::shared_ptr<TaskCompletion> completion_; // asyncRead/asyncWrite返回的TaskFuture的完成通知
+};
+
+/*
+Reactor 线程池的异步IO线程
+1.内核支持io_uring时，所有请求都交给io_uring，完成事件由Reactor线程收割
+2.否则管道、socket、eventfd等可以epoll的fd，等fd就绪后再读写
+3.普通文件不能epoll，在线程池的阻塞区里用pread/pwrite完成
+不管哪种方式，设置promise都在线程池的线程上执行
+*/
+class Reactor
+{
+public:
+	Reactor(ThreadPoolBase& pool, bool useIoUring);
+	~Reactor();
+
+	Reactor(const Reactor&) = delete;
+	Reactor& operator=(const Reactor&) = delete;
+
+	// 提交一个IO请求
+	void submit(std::unique_ptr<IoRequest> req);
+
+	// 停止Reactor线程，还没有完成的请求被丢弃，对应的future得到broken_promise异常
+	void stop();
+
+private:
+	// 初始化io_uring，内核不支持时返回false
+	bool setupIoUring();
+
+	// 把请求放进io_uring的提交队列，队列满了返回false
+	bool submitIoUring(IoRequest* req);
+
+	// 把请求放进fd的等待队列，epoll不支持这个fd时返回false
+	bool submitEpoll(IoRequest* req);
+
+	// 在线程池的阻塞区里完成请求
+	void submitBlocking(IoRequest* req);
+
+	// fd的一个读(写)请求完成后，继续等待这个fd的下一个读(写)请求
+	void rearm(int fd, IoRequest::Op op);
+
+	// Reactor线程函数
+	void ioUringLoop();
+	void epollLoop();
+
+	// 在线程池的线程上执行IO并设置结果
+	static ssize_t doIo(IoRequest* req);
+
+	// 把完成的请求交给线程池的线程设置结果
+	void complete(IoRequest* req, ssize_t res);
+
+private:
+	ThreadPoolBase& pool_;
+	std::thread thread_; // Reactor线程
+	std::atomic_bool isStopped_; // 同时持有sqMtx_和waitQueMtx_时修改
+
+	// io_uring
+	int ringFd_; // 小于0表示没有使用io_uring
+	unsigned sqEntries_;
+	unsigned cqEntries_;
+	unsigned* sqHead_;
+	unsigned* sqTail_;
+	unsigned* sqMask_;
+	unsigned* sqArray_;
+	unsigned* cqHead_;
+	unsigned* cqTail_;
+	unsigned* cqMask_;
+	void* sqRing_;
+	size_t sqRingSize_;
+	void* cqRing_;
+	size_t cqRingSize_;
+	void* sqes_;
+	size_t sqesSize_;
+	void* cqes_;
+	std::unordered_set<IoRequest*> inflight_; // 已经提交还没有收割的请求，数量不超过cqEntries_，避免完成队列溢出
+	std::mutex sqMtx_; // 保护提交队列和inflight_
+
+	// epoll
+	int epollFd_;
+	int wakeFd_; // eventfd，用来唤醒epoll_wait退出
+	// 一个fd上等待的请求		读和写分开排队，等待读的请求不会挡住后面的写，反过来也一样
+	// 同一个方向的请求按顺序一个一个执行
+	struct FdQueue
+	{
+		std::deque<IoRequest*> readQue_; // 队头的请求在fd可读时执行
+		std::deque<IoRequest*> writeQue_; // 队头的请求在fd可写时执行
+		bool isReadBusy_ = false; // 是否有读请求正在线程池的线程上执行
+		bool isWriteBusy_ = false; // 是否有写请求正在线程池的线程上执行
+	};
+	std::unordered_map<int, FdQueue> waitQue_; // fd在waitQue_里时一定注册在epoll上
+	std::mutex waitQueMtx_; // 保护waitQue_
+
+	// 按两个方向的队列重新注册fd：有请求在等待并且这个方向没有请求在执行时等待对应的事件
+	// 两个方向都没有请求时从epoll删除，queue随之失效		调用者已经持有waitQueMtx_
+	void arm(int fd, FdQueue& queue);
+};
+
+#endif // __linux__
+
+#endif
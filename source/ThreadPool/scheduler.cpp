@@ -0,0 +1,160 @@
+#include "scheduler.h"
+#include "threadpool.h"
+
+Scheduler& Scheduler::instance()
+{
+	static Scheduler* scheduler = new Scheduler();
+	return *scheduler;
+}
+
+Scheduler::Scheduler() : isStarted_(false), cursor_(entries_.end())
+{
+
+}
+
+// 启动共享线程
+void Scheduler::start(int threadSize)
+{
+	std::lock_guard<std::mutex> lock(mtx_);
+	if (isStarted_)
+	{
+		return;
+	}
+
+	for (int i = 0; i < std::max(threadSize, 1); i++)
+	{
+		// 线程ID和线程池的线程使用同一个计数器，性能分析时不会重复
+		Thread thread(std::bind(&Scheduler::threadFunc, this, std::placeholders::_1, i));
+		thread.start();
+	}
+	isStarted_ = true;
+}
+
+// ThreadPool加入调度
+void Scheduler::attach(ThreadPoolBase* pool, int weight)
+{
+	std::lock_guard<std::mutex> lock(mtx_);
+	entries_.push_back({ pool, weight, weight, 0 });
+	if (cursor_ == entries_.end())
+	{
+		cursor_ = entries_.begin();
+	}
+	// start之前可能已经提交了任务
+	notEmpty_.notify_all();
+}
+
+// ThreadPool离开调度		调用时ThreadPool已经没有任务了
+void Scheduler::detach(ThreadPoolBase* pool)
+{
+	std::unique_lock<std::mutex> lock(mtx_);
+	auto it = std::find_if(entries_.begin(), entries_.end(), [&](const Entry& entry) { return entry.pool_ == pool; });
+	if (it == entries_.end())
+	{
+		return;
+	}
+
+	// 等待已经选中这个ThreadPool的线程离开，之后不会再有线程访问它
+	notActive_.wait(lock, [&]()->bool { return it->activeSize_ == 0; });
+
+	if (cursor_ == it)
+	{
+		++cursor_;
+	}
+	entries_.erase(it);
+}
+
+// 修改ThreadPool的权重
+void Scheduler::setWeight(ThreadPoolBase* pool, int weight)
+{
+	std::lock_guard<std::mutex> lock(mtx_);
+	for (Entry& entry : entries_)
+	{
+		if (entry.pool_ == pool)
+		{
+			entry.weight_ = weight;
+			entry.credit_ = std::min(entry.credit_, weight);
+		}
+	}
+}
+
+// ThreadPool有新的任务
+void Scheduler::notify()
+{
+	std::lock_guard<std::mutex> lock(mtx_);
+	notEmpty_.notify_one();
+}
+
+// 按权重轮流选择ThreadPool		调用者已经持有mtx_
+// 轮到的ThreadPool用完这一轮的次数或者没有任务时，换下一个ThreadPool，并恢复它下一轮的次数
+Scheduler::Entry* Scheduler::pick(const std::vector<Entry*>& skipped)
+{
+	// 多看一次，回到起点时可以选择刚刚恢复了次数的ThreadPool
+	for (size_t i = 0; i <= entries_.size(); i++)
+	{
+		if (cursor_ == entries_.end())
+		{
+			cursor_ = entries_.begin();
+			if (cursor_ == entries_.end())
+			{
+				return nullptr;
+			}
+		}
+
+		Entry& entry = *cursor_;
+		if (entry.credit_ > 0 && entry.pool_->hasSharedTask()
+			&& std::find(skipped.begin(), skipped.end(), &entry) == skipped.end())
+		{
+			entry.credit_--;
+			return &entry;
+		}
+		entry.credit_ = entry.weight_;
+		++cursor_;
+	}
+	return nullptr;
+}
+
+// 共享线程函数		共享线程不会退出
+void Scheduler::threadFunc(int threadid, int index)
+{
+	Profiler::setCurrentThread(threadid);
+	ThreadPoolBase::setCurrentWorkerIndex(index);
+
+	std::vector<Entry*> skipped; // 这一轮取任务失败的ThreadPool
+	std::unique_lock<std::mutex> lock(mtx_);
+	for (;;)
+	{
+		Entry* entry = pick(skipped);
+		if (entry == nullptr)
+		{
+			notEmpty_.wait(lock);
+			skipped.clear();
+			continue;
+		}
+
+		// 占用这个ThreadPool，detach会等待
+		entry->activeSize_++;
+		ThreadPoolBase* pool = entry->pool_;
+		lock.unlock();
+
+		// 执行任务时不持有mtx_
+		bool isPopped = pool->runSharedTask();
+
+		lock.lock();
+		entry->activeSize_--;
+		if (entry->activeSize_ == 0)
+		{
+			notActive_.notify_all();
+		}
+
+		// 有任务但是取不到(比如租户达到了并发上限)，这一轮跳过这个ThreadPool，避免空转
+		// 执行完一个任务或者被唤醒后重新检查所有ThreadPool
+		if (isPopped)
+		{
+			skipped.clear();
+		}
+		else
+		{
+			skipped.push_back(entry);
+		}
+	}
+}
@@ -0,0 +1,77 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPoolBase;
+
+/*
+Scheduler 进程内共享的线程集合
+启用以后，之后start的ThreadPool不再创建自己的线程，只保留自己的任务队列、上限和权重
+所有ThreadPool的任务都由Scheduler的线程执行，整个进程的线程数量等于Scheduler的线程数量
+多个ThreadPool之间按权重轮流调度(weighted round robin)
+*/
+class Scheduler
+{
+public:
+	// 进程内唯一的Scheduler，永远不析构，避免和静态的ThreadPool对象析构顺序冲突
+	static Scheduler& instance();
+
+	// 启动共享线程，只有第一次调用有效
+	void start(int threadSize);
+
+	// 是否已经启动
+	bool isStarted() const
+	{
+		return isStarted_;
+	}
+
+	// ThreadPool加入和离开调度
+	// detach会等待正在处理这个ThreadPool的线程离开
+	void attach(ThreadPoolBase* pool, int weight);
+	void detach(ThreadPoolBase* pool);
+
+	// 修改ThreadPool的权重
+	void setWeight(ThreadPoolBase* pool, int weight);
+
+	// ThreadPool有新的任务，唤醒一个线程
+	void notify();
+
+private:
+	Scheduler();
+	~Scheduler() = default;
+
+	Scheduler(const Scheduler&) = delete;
+	Scheduler& operator=(const Scheduler&) = delete;
+
+	// 一个加入调度的ThreadPool
+	struct Entry
+	{
+		ThreadPoolBase* pool_;
+		int weight_; // 每一轮最多连续调度的次数
+		int credit_; // 这一轮还可以调度的次数
+		int activeSize_; // 正在取这个ThreadPool的任务或者执行它的任务的线程数量
+	};
+
+	// 共享线程的线程函数，index是共享线程的编号
+	void threadFunc(int threadid, int index);
+
+	// 按权重轮流选一个有任务可以执行的ThreadPool，跳过skipped里的，没有时返回nullptr
+	// 调用者必须已经持有mtx_
+	Entry* pick(const std::vector<Entry*>& skipped);
+
+private:
+	std::atomic_bool isStarted_;
+	std::list<Entry> entries_; // 加入调度的ThreadPool，list保证Entry的地址不变
+	std::list<Entry>::iterator cursor_; // 轮到的ThreadPool
+	std::mutex mtx_; // 保护entries_和cursor_
+	std::condition_variable notEmpty_; // 有ThreadPool有任务
+	std::condition_variable notActive_; // 有线程离开了ThreadPool，detach在上面等待
+};
+
+#endif
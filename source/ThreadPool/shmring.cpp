@@ -0,0 +1,447 @@
+#include "shmring.h"
+
+#ifdef __linux__
+
+#include "threadpool.h"
+
+#include <cerrno>
+#include <climits>
+#include <new>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+const uint32_t SHM_MAGIC = 0x54504f4c; // 共享内存初始化完成的标记
+const int SHM_DISPATCH_WAIT = 100; // 分发线程每次最多等待的时间(请求或者任务队列不满)，单位ms，检查是否停止
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared memory rings need lock free 32-bit atomics");
+
+// 单生产者单消费者的环形队列的控制信息		消息保存在共享内存后面的数组里
+// head_和tail_一直增加，取模得到位置，两者之差是队列里的消息数量
+struct ShmRing
+{
+	alignas(64) std::atomic<uint32_t> head_; // 消费者修改
+	alignas(64) std::atomic<uint32_t> tail_; // 生产者修改
+	alignas(64) std::atomic<uint32_t> seq_; // 每写入一个消息加一，消费者在上面futex等待
+	std::atomic<uint32_t> isWaiting_; // 消费者是否在等待，生产者只在有人等待时调用futex唤醒
+};
+
+// 一个客户端使用的通道
+struct ShmChannel
+{
+	std::atomic<uint32_t> ownerPid_; // 占用这个通道的客户端进程，0表示空闲
+	ShmRing submitRing_; // 客户端 -> 线程池
+	ShmRing completeRing_; // 线程池 -> 客户端
+};
+
+// 共享内存的开头		后面依次是channelSize_个ShmChannel，channelSize_ * 2 * capacity_个ShmMessage
+struct ShmSegment
+{
+	std::atomic<uint32_t> magic_; // 初始化完成后写入SHM_MAGIC
+	uint32_t channelSize_;
+	uint32_t capacity_; // 每个队列的长度，2的幂
+	alignas(64) std::atomic<uint32_t> submitSeq_; // 任何一个通道提交了请求就加一，分发线程在上面futex等待
+	std::atomic<uint32_t> isServerWaiting_; // 分发线程是否在等待
+
+	ShmChannel* channels()
+	{
+		return reinterpret_cast<ShmChannel*>(this + 1);
+	}
+
+	// 通道的提交队列(isComplete为false)或者完成队列的消息数组
+	ShmMessage* messages(int channel, bool isComplete)
+	{
+		ShmMessage* base = reinterpret_cast<ShmMessage*>(channels() + channelSize_);
+		return base + ((size_t)channel * 2 + (isComplete ? 1 : 0)) * capacity_;
+	}
+};
+
+static size_t segmentSizeOf(uint32_t channelSize, uint32_t capacity)
+{
+	return sizeof(ShmSegment) + channelSize * sizeof(ShmChannel) + (size_t)channelSize * 2 * capacity * sizeof(ShmMessage);
+}
+
+// 进程间共享的futex		不能使用FUTEX_PRIVATE_FLAG
+static void futexWait(std::atomic<uint32_t>* addr, uint32_t expected, const timespec* timeout)
+{
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT, expected, timeout, nullptr, 0);
+}
+
+static void futexWake(std::atomic<uint32_t>* addr)
+{
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+static timespec toTimespec(std::chrono::nanoseconds time)
+{
+	timespec ts;
+	ts.tv_sec = (time_t)std::chrono::duration_cast<std::chrono::seconds>(time).count();
+	ts.tv_nsec = (long)(time.count() % 1000000000);
+	return ts;
+}
+
+// 生产者写入一个消息，唤醒等待的消费者		调用者保证队列不满
+static void pushMessage(ShmRing& ring, ShmMessage* messages, uint32_t capacity, const ShmMessage& message)
+{
+	uint32_t tail = ring.tail_.load(std::memory_order_relaxed);
+	messages[tail & (capacity - 1)] = message;
+	ring.tail_.store(tail + 1, std::memory_order_release);
+	ring.seq_.fetch_add(1);
+	if (ring.isWaiting_.load())
+	{
+		futexWake(&ring.seq_);
+	}
+}
+
+// 消费者取出一个消息，队列为空时返回false
+static bool popMessage(ShmRing& ring, ShmMessage* messages, uint32_t capacity, ShmMessage& message)
+{
+	uint32_t head = ring.head_.load(std::memory_order_relaxed);
+	if (head == ring.tail_.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+	message = messages[head & (capacity - 1)];
+	ring.head_.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+//---------------------------ShmServer方法实现-------------------
+ShmServer::ShmServer(ThreadPoolBase& pool, const std::string& name, Handler handler, int channelSize, int capacity)
+	: pool_(pool), name_(name), handler_(std::move(handler)), segment_(nullptr), segmentSize_(0)
+	, isStopped_(false), runningSize_(0)
+{
+	uint32_t channels = (uint32_t)std::max(channelSize, 1);
+	uint32_t entries = 1;
+	while (entries < (uint32_t)std::max(capacity, 1))
+	{
+		entries <<= 1;
+	}
+
+	// 同名的共享内存已经存在时失败(EEXIST)，不删除别人正在使用的共享内存
+	int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0)
+	{
+		return;
+	}
+	size_t size = segmentSizeOf(channels, entries);
+	void* addr = MAP_FAILED;
+	if (ftruncate(fd, (off_t)size) == 0)
+	{
+		addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (addr == MAP_FAILED)
+	{
+		shm_unlink(name_.c_str());
+		return;
+	}
+
+	// ftruncate出来的内存全是0，原子变量用placement new构造
+	ShmSegment* segment = new (addr) ShmSegment();
+	segment->channelSize_ = channels;
+	segment->capacity_ = entries;
+	for (uint32_t i = 0; i < channels; i++)
+	{
+		new (segment->channels() + i) ShmChannel();
+	}
+	segment->magic_.store(SHM_MAGIC, std::memory_order_release);
+
+	segment_ = segment;
+	segmentSize_ = size;
+	completeMtx_.reset(new std::mutex[channels]);
+	thread_ = std::thread(&ShmServer::dispatchLoop, this);
+}
+
+ShmServer::~ShmServer()
+{
+	if (segment_ == nullptr)
+	{
+		return;
+	}
+
+	isStopped_ = true;
+	futexWake(&segment_->submitSeq_);
+	thread_.join();
+
+	// 已经交给线程池的请求会访问共享内存，等它们执行完
+	{
+		std::unique_lock<std::mutex> lock(runningMtx_);
+		runningCond_.wait(lock, [&]()->bool { return runningSize_ == 0; });
+	}
+
+	// 删除名字后客户端已经映射的内存仍然有效，新的客户端打不开
+	munmap(segment_, segmentSize_);
+	shm_unlink(name_.c_str());
+}
+
+// 删除共享内存
+bool ShmServer::cleanup(const std::string& name)
+{
+	return shm_unlink(name.c_str()) == 0;
+}
+
+// 分发线程函数
+void ShmServer::dispatchLoop()
+{
+	while (!isStopped_)
+	{
+		// 先记下序号再检查队列，检查之后提交的请求会改变序号，futex不会睡眠
+		uint32_t seq = segment_->submitSeq_.load();
+		int dispatched = 0;
+		for (uint32_t i = 0; i < segment_->channelSize_; i++)
+		{
+			dispatched += dispatch((int)i);
+		}
+
+		if (dispatched > 0)
+		{
+			continue;
+		}
+
+		segment_->isServerWaiting_.store(1);
+		if (segment_->submitSeq_.load() == seq && !isStopped_)
+		{
+			timespec timeout = toTimespec(std::chrono::milliseconds(SHM_DISPATCH_WAIT));
+			futexWait(&segment_->submitSeq_, seq, &timeout);
+		}
+		segment_->isServerWaiting_.store(0);
+	}
+}
+
+// 把通道里的请求交给线程池
+int ShmServer::dispatch(int channel)
+{
+	ShmRing& ring = segment_->channels()[channel].submitRing_;
+	ShmMessage* messages = segment_->messages(channel, false);
+	uint32_t capacity = segment_->capacity_;
+
+	int dispatched = 0;
+	for (;;)
+	{
+		uint32_t head = ring.head_.load(std::memory_order_relaxed);
+		if (head == ring.tail_.load(std::memory_order_acquire))
+		{
+			return dispatched;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(runningMtx_);
+			runningSize_++;
+		}
+		// 请求拷贝进任务，共享内存里的位置马上可以复用
+		// 任务队列满时在线程池的条件变量上等待，不轮询，每次最多等SHM_DISPATCH_WAIT检查是否停止
+		ShmMessage request = messages[head & (capacity - 1)];
+		while (!pool_.tryPostFor(std::chrono::milliseconds(SHM_DISPATCH_WAIT), [this, channel, request]() { execute(channel, request); }))
+		{
+			if (isStopped_)
+			{
+				std::lock_guard<std::mutex> lock(runningMtx_);
+				if (--runningSize_ == 0)
+				{
+					runningCond_.notify_all();
+				}
+				return dispatched;
+			}
+		}
+		ring.head_.store(head + 1, std::memory_order_release);
+		dispatched++;
+	}
+}
+
+// 线程池的线程调用：执行请求，写回结果
+void ShmServer::execute(int channel, const ShmMessage& request)
+{
+	ShmMessage response;
+	response.requestId_ = request.requestId_;
+	response.type_ = request.type_;
+	response.size_ = 0;
+	try
+	{
+		handler_(request, response);
+	}
+	catch (...)
+	{
+		// 仍然写回结果：客户端不会一直等待，这个请求在完成队列里占的位置也能归还
+		response.size_ = 0;
+		reply(channel, response);
+		throw;
+	}
+	reply(channel, response);
+}
+
+// 写回结果
+void ShmServer::reply(int channel, const ShmMessage& response)
+{
+	{
+		// 客户端没有取回结果的请求数量不超过队列长度，完成队列不会满
+		std::lock_guard<std::mutex> lock(completeMtx_[channel]);
+		pushMessage(segment_->channels()[channel].completeRing_, segment_->messages(channel, true), segment_->capacity_, response);
+	}
+
+	std::lock_guard<std::mutex> lock(runningMtx_);
+	if (--runningSize_ == 0)
+	{
+		runningCond_.notify_all();
+	}
+}
+
+//---------------------------ShmClient方法实现-------------------
+ShmClient::ShmClient(const std::string& name)
+	: segment_(nullptr), segmentSize_(0), channel_(nullptr), nextRequestId_(1)
+{
+	int fd = shm_open(name.c_str(), O_RDWR, 0600);
+	if (fd < 0)
+	{
+		return;
+	}
+	struct stat st;
+	void* addr = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ShmSegment))
+	{
+		addr = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (addr == MAP_FAILED)
+	{
+		return;
+	}
+
+	segment_ = static_cast<ShmSegment*>(addr);
+	segmentSize_ = (size_t)st.st_size;
+	// 服务端还没有初始化完成，或者大小不对
+	if (segment_->magic_.load(std::memory_order_acquire) != SHM_MAGIC
+		|| segmentSizeOf(segment_->channelSize_, segment_->capacity_) > segmentSize_)
+	{
+		return;
+	}
+
+	// 占用一个空闲通道
+	uint32_t pid = (uint32_t)getpid();
+	for (uint32_t i = 0; i < segment_->channelSize_; i++)
+	{
+		uint32_t expected = 0;
+		if (segment_->channels()[i].ownerPid_.compare_exchange_strong(expected, pid))
+		{
+			channel_ = segment_->channels() + i;
+			return;
+		}
+	}
+
+	// 没有空闲通道时，回收占用者进程已经不存在的通道(崩溃或者被杀死，没有归还)
+	// 多个客户端同时回收同一个通道时只有一个成功
+	for (uint32_t i = 0; i < segment_->channelSize_; i++)
+	{
+		ShmChannel& channel = segment_->channels()[i];
+		uint32_t owner = channel.ownerPid_.load();
+		if (owner != 0 && kill((pid_t)owner, 0) < 0 && errno == ESRCH
+			&& channel.ownerPid_.compare_exchange_strong(owner, pid))
+		{
+			channel_ = &channel;
+			// 上一个客户端提交的请求可能还在执行，取回它们的结果，之后收到的都是自己的结果
+			drain();
+			return;
+		}
+	}
+}
+
+ShmClient::~ShmClient()
+{
+	if (channel_ != nullptr)
+	{
+		// 取回还没有取回的结果，下一个占用这个通道的客户端不会收到它们
+		drain();
+		channel_->ownerPid_.store(0);
+	}
+	if (segment_ != nullptr)
+	{
+		munmap(segment_, segmentSize_);
+	}
+}
+
+// 取回通道里已经提交的请求的所有结果，每个结果最多等待1s
+void ShmClient::drain()
+{
+	ShmMessage response;
+	while (channel_->submitRing_.tail_.load() != channel_->completeRing_.head_.load()
+		&& wait(response, std::chrono::seconds(1)))
+	{
+	}
+}
+
+// 提交请求
+uint64_t ShmClient::submit(const ShmMessage& request)
+{
+	if (channel_ == nullptr)
+	{
+		return 0;
+	}
+
+	// 限制没有取回结果的请求数量，保证线程池写结果时完成队列不会满
+	uint32_t capacity = segment_->capacity_;
+	if (channel_->submitRing_.tail_.load(std::memory_order_relaxed) - channel_->completeRing_.head_.load(std::memory_order_relaxed) >= capacity)
+	{
+		return 0;
+	}
+
+	ShmMessage message = request;
+	message.requestId_ = nextRequestId_++;
+	int index = (int)(channel_ - segment_->channels());
+	pushMessage(channel_->submitRing_, segment_->messages(index, false), capacity, message);
+
+	// 唤醒分发线程
+	segment_->submitSeq_.fetch_add(1);
+	if (segment_->isServerWaiting_.load())
+	{
+		futexWake(&segment_->submitSeq_);
+	}
+	return message.requestId_;
+}
+
+// 取一个结果
+bool ShmClient::wait(ShmMessage& response, std::chrono::milliseconds timeout)
+{
+	if (channel_ == nullptr)
+	{
+		return false;
+	}
+
+	ShmRing& ring = channel_->completeRing_;
+	ShmMessage* messages = segment_->messages((int)(channel_ - segment_->channels()), true);
+	bool isForever = timeout == std::chrono::milliseconds::max();
+	auto deadline = std::chrono::steady_clock::now() + (isForever ? std::chrono::milliseconds(0) : timeout);
+	for (;;)
+	{
+		uint32_t seq = ring.seq_.load();
+		if (popMessage(ring, messages, segment_->capacity_, response))
+		{
+			return true;
+		}
+
+		timespec ts;
+		const timespec* wait = nullptr;
+		if (!isForever)
+		{
+			auto remain = deadline - std::chrono::steady_clock::now();
+			if (remain <= std::chrono::nanoseconds(0))
+			{
+				return false;
+			}
+			ts = toTimespec(std::chrono::duration_cast<std::chrono::nanoseconds>(remain));
+			wait = &ts;
+		}
+
+		ring.isWaiting_.store(1);
+		if (ring.seq_.load() == seq)
+		{
+			futexWait(&ring.seq_, seq, wait);
+		}
+		ring.isWaiting_.store(0);
+	}
+}
+
+#endif // __linux__
@@ -0,0 +1,175 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#ifdef __linux__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+class ThreadPoolBase;
+
+const size_t SHM_MESSAGE_DATA_SIZE = 240; // 一个消息最多携带的字节数
+
+// 共享内存环形队列里的一个消息		请求和结果使用同样的格式
+// 只能携带可以直接按字节拷贝的数据，不能有指针(不同进程的地址空间不同)
+struct ShmMessage
+{
+	uint64_t requestId_; // 请求编号，submit时分配，结果里带回同样的编号
+	uint32_t type_; // 由使用者定义，比如区分不同的请求
+	uint32_t size_; // data_里有效的字节数
+	char data_[SHM_MESSAGE_DATA_SIZE];
+
+	// 写入一个可以按字节拷贝的对象
+	template<typename T>
+	void set(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "ShmMessage can only carry trivially copyable types");
+		static_assert(sizeof(T) <= SHM_MESSAGE_DATA_SIZE, "type is too large for ShmMessage");
+		std::memcpy(data_, &value, sizeof(T));
+		size_ = sizeof(T);
+	}
+
+	// 读出一个可以按字节拷贝的对象
+	template<typename T>
+	T get() const
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "ShmMessage can only carry trivially copyable types");
+		static_assert(sizeof(T) <= SHM_MESSAGE_DATA_SIZE, "type is too large for ShmMessage");
+		T value;
+		std::memcpy(&value, data_, sizeof(T));
+		return value;
+	}
+};
+
+struct ShmSegment;
+struct ShmChannel;
+
+/*
+ShmServer 把线程池通过共享内存开放给同一台机器上的其它进程
+创建名为name的共享内存(shm_open + mmap)，里面有channelSize个通道，每个通道一对单生产者单消费者的环形队列：
+提交队列由客户端进程写入请求，完成队列由线程池写回结果
+服务端的分发线程把请求交给线程池，线程池的线程调用handler，结果放进对应通道的完成队列
+没有请求时分发线程和客户端都在共享内存里的futex上等待，不需要socket
+
+example:
+// 服务端进程
+ShmServer server(pool, "/my-pool", [](const ShmMessage& request, ShmMessage& response) {
+	auto args = request.get<AddArgs>();
+	response.set(args.a + args.b);
+});
+
+// 客户端进程
+ShmClient client("/my-pool");
+ShmMessage request{};
+request.set(AddArgs{ 1, 2 });
+client.submit(request);
+ShmMessage response;
+client.wait(response);
+*/
+class ShmServer
+{
+public:
+	// 处理一个请求，在线程池的线程上调用		response的requestId_已经设置好
+	// 抛出异常时客户端收到size_为0的结果，异常由线程池报告
+	using Handler = std::function<void(const ShmMessage& request, ShmMessage& response)>;
+
+	// capacity是每个队列的长度，向上取整到2的幂
+	// 同名的共享内存已经存在时不覆盖，isOpen()返回false：可能有另一个服务端正在使用，也可能是上一次异常退出留下的
+	// 确认没有服务端在使用后，用cleanup删除再重新创建
+	ShmServer(ThreadPoolBase& pool, const std::string& name, Handler handler, int channelSize = 16, int capacity = 256);
+
+	// 停止分发线程，等待已经交给线程池的请求执行完，删除共享内存
+	~ShmServer();
+
+	ShmServer(const ShmServer&) = delete;
+	ShmServer& operator=(const ShmServer&) = delete;
+
+	// 共享内存是否创建成功
+	bool isOpen() const
+	{
+		return segment_ != nullptr;
+	}
+
+	// 删除名为name的共享内存，返回是否删除了		已经映射的进程不受影响，之后的客户端打不开
+	static bool cleanup(const std::string& name);
+
+private:
+	// 分发线程函数
+	void dispatchLoop();
+
+	// 把通道里的请求交给线程池，返回交出的数量
+	// 线程池的任务队列满时等待，期间停止则把剩下的请求留在共享内存里返回
+	int dispatch(int channel);
+
+	// 线程池的线程调用：执行请求，写回结果
+	void execute(int channel, const ShmMessage& request);
+
+	// 把结果放进通道的完成队列，这个请求执行完
+	void reply(int channel, const ShmMessage& response);
+
+private:
+	ThreadPoolBase& pool_;
+	std::string name_;
+	Handler handler_;
+	ShmSegment* segment_; // 映射的共享内存，创建失败时为nullptr
+	size_t segmentSize_;
+	std::unique_ptr<std::mutex[]> completeMtx_; // 每个通道一个，线程池的多个线程写同一个完成队列时互斥
+	std::thread thread_; // 分发线程
+	std::atomic_bool isStopped_;
+	int runningSize_; // 已经交给线程池还没有执行完的请求数量
+	std::mutex runningMtx_; // 保护runningSize_
+	std::condition_variable runningCond_; // 等待runningSize_变成0
+};
+
+/*
+ShmClient 在其它进程里向ShmServer提交请求
+打开时占用一个空闲的通道，析构时归还，一个ShmClient只能在一个线程里使用
+通道记录占用者的pid，占用者异常退出没有归还时，没有空闲通道的新客户端回收它(kill(pid, 0)返回ESRCH)
+限制：客户端要和其它客户端在同一个pid namespace里；占用者的pid被新进程复用时，要等那个进程也退出才能回收
+*/
+class ShmClient
+{
+public:
+	// 打开服务端创建的共享内存，没有空闲通道(也没有可以回收的通道)或者共享内存不存在时isOpen()返回false
+	ShmClient(const std::string& name);
+	~ShmClient();
+
+	ShmClient(const ShmClient&) = delete;
+	ShmClient& operator=(const ShmClient&) = delete;
+
+	bool isOpen() const
+	{
+		return channel_ != nullptr;
+	}
+
+	// 提交请求，返回分配的请求编号
+	// 没有取回结果的请求数量达到队列长度时不等待，返回0
+	uint64_t submit(const ShmMessage& request);
+
+	// 取一个结果，结果按执行完的顺序返回，用requestId_对应请求
+	// 最多等待timeout，超时返回false
+	bool wait(ShmMessage& response, std::chrono::milliseconds timeout = std::chrono::milliseconds::max());
+
+private:
+	// 取回通道里还没有取回的结果并丢弃
+	void drain();
+
+private:
+	ShmSegment* segment_;
+	size_t segmentSize_;
+	ShmChannel* channel_; // 占用的通道，打开失败时为nullptr
+	uint64_t nextRequestId_;
+};
+
+#endif // __linux__
+
+#endif
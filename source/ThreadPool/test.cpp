@@ -2,7 +2,21 @@
 
 
 #include "threadpool.h"
+#include "shmring.h"
+#include "parallel.h"
 #include<chrono>
+#include <cassert>
+#include <cstring>
+#include <map>
+#include <set>
+#include <sstream>
+#include <numeric>
+#include <random>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#endif
 using namespace std;
 
 
@@ -31,8 +45,1229 @@ int sum2(int a, int b, int c)
     return a + b + c;
 }
 
+#ifdef __linux__
+// Reactor：临时文件按偏移读写
+void testReactorFile(bool useIoUring)
+{
+    ThreadPool pool;
+    pool.start(2);
+    pool.startReactor(useIoUring);
+
+    char path[] = "/tmp/threadpool-testXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    unlink(path);
+
+    assert(pool.asyncWrite(fd, "hello world", 11, 0).get() == 11);
+    assert(pool.asyncWrite(fd, "WORLD", 5, 6).get() == 5);
+    char buf[32] = { 0 };
+    assert(pool.asyncRead(fd, buf, sizeof(buf), 0).get() == 11);
+    assert(strcmp(buf, "hello WORLD") == 0);
+
+    // 读到文件末尾返回0，错误返回-errno
+    assert(pool.asyncRead(fd, buf, sizeof(buf), 11).get() == 0);
+    close(fd);
+    assert(pool.asyncRead(fd, buf, sizeof(buf), 0).get() == -EBADF);
+}
+
+// Reactor：管道上先提交读请求，写入之后完成
+void testReactorPipe(bool useIoUring)
+{
+    ThreadPool pool;
+    pool.start(2);
+    pool.startReactor(useIoUring);
+
+    int fds[2];
+    assert(pipe(fds) == 0);
+    char b1[4] = { 0 };
+    char b2[4] = { 0 };
+    auto r1 = pool.asyncRead(fds[0], b1, 3);
+    auto r2 = pool.asyncRead(fds[0], b2, 3);
+    assert(r1.wait_for(chrono::milliseconds(50)) == future_status::timeout);
+
+    assert(pool.asyncWrite(fds[1], "abc", 3).get() == 3);
+    assert(pool.asyncWrite(fds[1], "def", 3).get() == 3);
+    assert(r1.get() == 3 && r2.get() == 3);
+    // io_uring不保证同一个fd上读请求的完成顺序，epoll按提交顺序
+    assert((strcmp(b1, "abc") == 0 && strcmp(b2, "def") == 0) || (useIoUring && strcmp(b1, "def") == 0 && strcmp(b2, "abc") == 0));
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// Reactor：同一个socket上等待中的读请求不挡住后面的写请求
+void testReactorSocket(bool useIoUring)
+{
+    ThreadPool pool;
+    pool.start(2);
+    pool.startReactor(useIoUring);
+
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    char buf[4] = { 0 };
+    auto read = pool.asyncRead(fds[0], buf, 3);
+    assert(read.wait_for(chrono::milliseconds(50)) == future_status::timeout);
+
+    // fds[0]上的写在读还没有完成时完成，对端收到后回写，读才完成
+    auto write = pool.asyncWrite(fds[0], "ping", 4);
+    assert(write.wait_for(chrono::seconds(2)) == future_status::ready && write.get() == 4);
+    char peer[4];
+    assert(::read(fds[1], peer, 4) == 4 && memcmp(peer, "ping", 4) == 0);
+    assert(read.wait_for(chrono::milliseconds(20)) == future_status::timeout);
+    assert(::write(fds[1], "abc", 3) == 3);
+    assert(read.get() == 3 && strcmp(buf, "abc") == 0);
+
+    // 两个方向都完成以后还能继续使用
+    assert(pool.asyncWrite(fds[1], "xyz", 3).get() == 3);
+    assert(pool.asyncRead(fds[0], buf, 3).get() == 3 && strcmp(buf, "xyz") == 0);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// Reactor：停止时还没有完成的请求被丢弃，future得到broken_promise
+void testReactorStop(bool useIoUring)
+{
+    int fds[2];
+    assert(pipe(fds) == 0);
+    char buf[4];
+    TaskFuture<ssize_t> pending;
+    {
+        ThreadPool pool;
+        pool.start(2);
+        pool.startReactor(useIoUring);
+        pending = pool.asyncRead(fds[0], buf, sizeof(buf));
+        assert(pending.wait_for(chrono::milliseconds(50)) == future_status::timeout);
+    } // 析构线程池时停止Reactor
+
+    try
+    {
+        pending.get();
+        assert(false);
+    }
+    catch (const future_error& e)
+    {
+        assert(e.code() == future_errc::broken_promise);
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// ShmServer：子进程通过共享内存提交5000个请求，每个请求等到结果再提交下一个
+// fork之前进程里不能有其它线程，放在最前面执行
+void testShmRoundTrip()
+{
+    const char* name = "/threadpool-test-shm";
+    const int count = 5000;
+    ShmServer::cleanup(name);
+
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0)
+    {
+        // 子进程：等服务端创建好共享内存
+        ShmClient* client = nullptr;
+        for (int i = 0; i < 500 && client == nullptr; i++)
+        {
+            client = new ShmClient(name);
+            if (!client->isOpen())
+            {
+                delete client;
+                client = nullptr;
+                usleep(10000);
+            }
+        }
+        if (client == nullptr)
+        {
+            _exit(2);
+        }
+
+        long long sum = 0;
+        for (int i = 1; i <= count; i++)
+        {
+            ShmMessage request{};
+            request.set(i);
+            ShmMessage response;
+            if (!client->submit(request) || !client->wait(response, chrono::seconds(5)))
+            {
+                _exit(3);
+            }
+            sum += response.get<long long>();
+        }
+        delete client;
+        // 结果是请求的两倍
+        _exit(sum == (long long)count * (count + 1) ? 0 : 4);
+    }
+
+    {
+        ThreadPool pool;
+        pool.start(2);
+        ShmServer server(pool, name, [](const ShmMessage& request, ShmMessage& response) {
+            response.set((long long)request.get<int>() * 2);
+        });
+        assert(server.isOpen());
+
+        // 同名的共享内存已经存在时不覆盖
+        ShmServer other(pool, name, [](const ShmMessage&, ShmMessage&) {});
+        assert(!other.isOpen());
+
+        int status = 0;
+        assert(waitpid(pid, &status, 0) == pid);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    } // 析构时删除共享内存
+
+    // 上一个服务端没有删除共享内存(比如进程崩溃)时，cleanup之后才能重新创建
+    ThreadPool pool;
+    pool.start(1);
+    ShmServer stale(pool, name, [](const ShmMessage&, ShmMessage&) {});
+    assert(stale.isOpen());
+    ShmServer blocked(pool, name, [](const ShmMessage&, ShmMessage&) {});
+    assert(!blocked.isOpen());
+    assert(ShmServer::cleanup(name));
+    ShmServer recreated(pool, name, [](const ShmMessage&, ShmMessage&) {});
+    assert(recreated.isOpen());
+    assert(ShmServer::cleanup(name));
+
+    // handler抛出异常时客户端仍然收到结果，服务端可以正常析构
+    {
+        ShmServer throwing(pool, name, [](const ShmMessage& request, ShmMessage& response) {
+            if (request.type_ == 1)
+            {
+                throw runtime_error("bad request");
+            }
+            response.set(request.get<int>());
+        });
+        ShmClient client(name);
+        assert(client.isOpen());
+        ShmMessage request{};
+        request.type_ = 1;
+        request.set(5);
+        uint64_t id = client.submit(request);
+        ShmMessage response;
+        assert(client.wait(response, chrono::seconds(5)));
+        assert(response.requestId_ == id && response.size_ == 0);
+
+        request.type_ = 0;
+        client.submit(request);
+        assert(client.wait(response, chrono::seconds(5)) && response.get<int>() == 5);
+    }
+}
+
+// ShmClient：占用通道的进程退出时没有归还，新的客户端回收这个通道，不会收到上一个客户端的结果
+// 在testShmRoundTrip之后执行，fork时前面的线程池都已经析构，没有其它线程
+void testShmReclaim()
+{
+    const char* name = "/threadpool-test-reclaim";
+    ShmServer::cleanup(name);
+
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0)
+    {
+        // 子进程：占用唯一的通道，提交一个请求后直接退出，不析构ShmClient
+        for (int i = 0; i < 500; i++)
+        {
+            ShmClient* client = new ShmClient(name);
+            if (client->isOpen())
+            {
+                ShmMessage request{};
+                request.set(-1);
+                _exit(client->submit(request) != 0 ? 0 : 3);
+            }
+            delete client;
+            usleep(10000);
+        }
+        _exit(2);
+    }
+
+    ThreadPool pool;
+    pool.start(2);
+    ShmServer server(pool, name, [](const ShmMessage& request, ShmMessage& response) {
+        response.set(request.get<int>());
+    }, 1);
+    assert(server.isOpen());
+    int status = 0;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    ShmClient client(name);
+    assert(client.isOpen());
+    // 只有一个通道，已经被占用
+    ShmClient other(name);
+    assert(!other.isOpen());
+
+    ShmMessage request{};
+    request.set(7);
+    uint64_t id = client.submit(request);
+    ShmMessage response;
+    assert(client.wait(response, chrono::seconds(5)));
+    assert(response.requestId_ == id && response.get<int>() == 7);
+}
+#endif
+
+// 等待线程池统计到的异常任务数量达到count
+bool waitFailedTasks(ThreadPool& pool, uint64_t count)
+{
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+    while (pool.getStats().failedTaskSize_ < count && chrono::steady_clock::now() < deadline)
+    {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    return pool.getStats().failedTaskSize_ == count;
+}
+
+// post的任务抛出异常：线程池报告后继续运行，Strand继续执行后面的任务
+void testPostException()
+{
+    ThreadPool pool;
+    pool.start(2);
+    pool.post([]() { throw runtime_error("post"); });
+    pool.post([]() { throw 1; });
+    assert(waitFailedTasks(pool, 2));
+    assert(pool.submitTask([]() { return 1; }).get() == 1);
+
+    auto strand = pool.makeStrand();
+    int count = 0;
+    strand->post([&count]() { count++; });
+    strand->post([]() { throw runtime_error("strand"); });
+    strand->post([&count]() { count++; });
+    assert(strand->submitTask([&count]() { return count; }).get() == 2);
+    assert(waitFailedTasks(pool, 3));
+
+    // submitTask的异常在future里，不计入
+    auto result = pool.submitTask([]()->int { throw runtime_error("submit"); });
+    try
+    {
+        result.get();
+        assert(false);
+    }
+    catch (const runtime_error&)
+    {
+    }
+    assert(pool.getStats().failedTaskSize_ == 3);
+}
+
+// 限流执行器：抛出异常的任务也归还并发名额，后面的任务不会一直等待
+void testLimitedException()
+{
+    ThreadPool pool;
+    pool.start(2);
+    auto limited = pool.limited(1);
+    limited->post([]() { throw runtime_error("limited"); });
+    assert(limited->submitTask([]() { return 1; }).get() == 1);
+    assert(waitFailedTasks(pool, 1));
+}
+
+// 限流执行器：线程池析构时丢弃还在等待令牌的任务，whenAll照常就绪
+void testRateLimitedDropped()
+{
+    shared_ptr<ThrottledExecutor> throttled;
+    TaskFuture<vector<TaskFuture<int>>> all;
+    {
+        ThreadPool pool;
+        pool.start(1);
+        throttled = pool.rateLimited(1, 1);
+        vector<TaskFuture<int>> futures;
+        for (int i = 0; i < 3; i++)
+        {
+            futures.push_back(throttled->submitTask([i]() { return i; }));
+        }
+        all = whenAll(std::move(futures));
+    }
+    assert(all.wait_for(chrono::seconds(2)) == future_status::ready);
+    auto futures = all.get();
+    assert(futures[0].get() == 0);
+    try
+    {
+        futures[2].get();
+        assert(false);
+    }
+    catch (const future_error& e)
+    {
+        assert(e.code() == future_errc::broken_promise);
+    }
+    assert(throttled->pendingTaskSize() == 0);
+}
+
+// Watchdog：抛出异常的任务结束后不再被当作还在执行
+void testWatchdogException()
+{
+    ThreadPool pool;
+    pool.start(1);
+    atomic_int reports(0);
+    pool.startWatchdog(chrono::milliseconds(50), [&reports](int workerId, const char*, chrono::milliseconds) {
+        if (workerId >= 0)
+        {
+            reports++;
+        }
+    });
+    pool.post([]() { throw runtime_error("watched"); });
+    assert(waitFailedTasks(pool, 1));
+    this_thread::sleep_for(chrono::milliseconds(200));
+    assert(reports == 0);
+}
+
+// Strand：同一个Strand的任务按提交顺序逐个执行，不同Strand之间并行
+void testStrandOrder()
+{
+    ThreadPool pool;
+    pool.start(4);
+    const int strandSize = 8;
+    const int taskSize = 500;
+    vector<shared_ptr<Strand>> strands;
+    vector<vector<int>> orders(strandSize);
+    vector<atomic_int> running(strandSize);
+    atomic_bool isOverlapped(false);
+    for (int i = 0; i < strandSize; i++)
+    {
+        strands.push_back(pool.makeStrand());
+    }
+
+    vector<future<int>> lasts;
+    for (int k = 0; k < taskSize; k++)
+    {
+        for (int i = 0; i < strandSize; i++)
+        {
+            auto result = strands[i]->submitTask([&, i, k]() {
+                if (running[i]++ != 0)
+                {
+                    isOverlapped = true;
+                }
+                orders[i].push_back(k);
+                running[i]--;
+                return k;
+            });
+            if (k == taskSize - 1)
+            {
+                lasts.push_back(std::move(result));
+            }
+        }
+    }
+    for (auto& last : lasts)
+    {
+        assert(last.get() == taskSize - 1);
+    }
+    assert(!isOverlapped);
+    for (auto& order : orders)
+    {
+        assert((int)order.size() == taskSize && is_sorted(order.begin(), order.end()));
+    }
+}
+
+// 亲和性：同一个key的任务在同一个线程上执行，线程忙时等待超过窃取延迟的任务被其它线程执行
+void testAffinity()
+{
+    {
+        ThreadPool pool;
+        pool.setAffinityStealDelay(chrono::seconds(10));
+        pool.start(4);
+        mutex mtx;
+        map<size_t, set<thread::id>> threads;
+        vector<future<size_t>> results;
+        for (int i = 0; i < 400; i++)
+        {
+            size_t key = i % 8;
+            results.push_back(pool.submitTask(key, [&mtx, &threads](size_t key) {
+                lock_guard<mutex> lock(mtx);
+                threads[key].insert(this_thread::get_id());
+                return key;
+            }, key));
+        }
+        for (int i = 0; i < 400; i++)
+        {
+            assert(results[i].get() == (size_t)i % 8);
+        }
+        for (auto& entry : threads)
+        {
+            assert(entry.second.size() == 1);
+        }
+    }
+
+    ThreadPool pool;
+    pool.setAffinityStealDelay(chrono::milliseconds(20));
+    pool.start(2);
+    promise<void> gate;
+    shared_future<void> opened = gate.get_future().share();
+    auto owner = pool.submitTask(0, [opened]() {
+        opened.wait();
+        return this_thread::get_id();
+    });
+    this_thread::sleep_for(chrono::milliseconds(10));
+    // key 0的线程被阻塞，这个任务超过窃取延迟后由另一个线程执行
+    auto start = chrono::steady_clock::now();
+    auto stolen = pool.submitTask(0, []() { return this_thread::get_id(); });
+    assert(stolen.wait_for(chrono::seconds(2)) == future_status::ready);
+    assert(chrono::steady_clock::now() - start >= chrono::milliseconds(20));
+    gate.set_value();
+    assert(stolen.get() != owner.get());
+}
+
+// 阻塞区：所有线程都阻塞时创建补偿线程执行其它任务，阻塞结束后多余的线程退出
+void testBlockingSection()
+{
+    ThreadPool pool;
+    pool.start(2);
+    promise<void> gate;
+    shared_future<void> opened = gate.get_future().share();
+    vector<future<int>> blocked;
+    for (int i = 0; i < 2; i++)
+    {
+        blocked.push_back(pool.submitTask([&pool, opened, i]() {
+            auto section = pool.blockingSection();
+            opened.wait();
+            return i;
+        }));
+    }
+    this_thread::sleep_for(chrono::milliseconds(50));
+    auto result = pool.submitTask([]() { return 3; });
+    assert(result.wait_for(chrono::seconds(2)) == future_status::ready && result.get() == 3);
+    assert(pool.getStats().threadSize_ > 2);
+
+    gate.set_value();
+    assert(blocked[0].get() + blocked[1].get() == 1);
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+    while (pool.getStats().threadSize_ > 2 && chrono::steady_clock::now() < deadline)
+    {
+        pool.post([]() {});
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    assert(pool.getStats().threadSize_ == 2);
+
+    // 不是线程池的线程时什么也不做
+    {
+        auto section = pool.blockingSection();
+    }
+    assert(pool.submitTask([]() { return 4; }).get() == 4);
+}
+
+// WorkerLocal：每个线程累加自己的实例，combine合并所有线程的结果，初始化和退出回调每个线程各一次
+void testWorkerLocal()
+{
+    atomic_int inits(0);
+    atomic_int exits(0);
+    WorkerLocal<long> sums;
+    {
+        ThreadPool pool;
+        pool.setWorkerInit([&inits](int) { inits++; });
+        pool.setWorkerExit([&exits](int) { exits++; });
+        pool.start(3);
+        vector<future<int>> results;
+        for (int i = 1; i <= 1000; i++)
+        {
+            results.push_back(pool.submitTask([&sums, i]() {
+                sums.local() += i;
+                return ThreadPool::currentWorkerIndex();
+            }));
+        }
+        set<int> indexes;
+        for (auto& result : results)
+        {
+            indexes.insert(result.get());
+        }
+        assert(*indexes.begin() >= 0 && *indexes.rbegin() < 3);
+        assert(sums.combine(0L, [](long a, long b) { return a + b; }) == 500500);
+
+        int count = 0;
+        sums.forEach([&count](long) { count++; });
+        assert(count == (int)indexes.size());
+
+        // 不是线程池的线程
+        assert(ThreadPool::currentWorkerIndex() == -1);
+        try
+        {
+            sums.local();
+            assert(false);
+        }
+        catch (const out_of_range&)
+        {
+        }
+    }
+    assert(inits == 3 && exits == 3);
+}
+
+// 开销上限：排队任务的开销之和超过上限时提交等待，任务开始执行后放行
+void testTaskCost()
+{
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(1000); // 只让开销上限起作用
+    pool.setTaskQueMaxCost(100);
+    pool.start(1);
+    promise<void> gate;
+    shared_future<void> opened = gate.get_future().share();
+    pool.post([opened]() { opened.wait(); });
+    this_thread::sleep_for(chrono::milliseconds(50));
+
+    TaskOption option;
+    option.cost_ = 40;
+    pool.post(option, []() {});
+    pool.post(option, []() {});
+    auto stats = pool.getStats();
+    assert(stats.taskSize_ == 2 && stats.queuedCost_ == 80);
+
+    // 再放一个就超过上限，等待1s后提交失败，future得到默认值
+    auto start = chrono::steady_clock::now();
+    auto failed = pool.submitTask(option, []() { return 5; });
+    assert(chrono::steady_clock::now() - start >= chrono::milliseconds(900));
+    assert(failed.get() == 0);
+
+    // 线程开始执行排队的任务后，等待中的提交成功
+    thread opener([&gate]() {
+        this_thread::sleep_for(chrono::milliseconds(100));
+        gate.set_value();
+    });
+    assert(pool.submitTask(option, []() { return 6; }).get() == 6);
+    opener.join();
+    stats = pool.getStats();
+    assert(stats.queuedCost_ == 0 && stats.peakQueuedCost_ >= 80);
+
+    // 队列为空时开销超过上限的单个任务也可以提交
+    TaskOption big;
+    big.cost_ = 1000;
+    assert(pool.submitTask(big, []() { return 7; }).get() == 7);
+}
+
+// 多租户：租户按权重轮流执行，后提交的租户不会排在积压的租户后面，并发上限生效
+void testTenants()
+{
+    string order;
+    {
+        ThreadPool pool;
+        pool.setTaskQueMaxThreshHold(1000);
+        pool.start(1);
+        pool.setTenantWeight(2, 2);
+        promise<void> gate;
+        shared_future<void> opened = gate.get_future().share();
+        pool.post([opened]() { opened.wait(); });
+        this_thread::sleep_for(chrono::milliseconds(50));
+
+        for (int tenant : { 1, 2 })
+        {
+            TaskOption option;
+            option.tenant_ = tenant;
+            for (int i = 0; i < 100; i++)
+            {
+                pool.post(option, [&order, tenant]() { order.push_back('0' + tenant); });
+            }
+        }
+        TaskOption quiet;
+        quiet.tenant_ = 3;
+        pool.post(quiet, [&order]() { order.push_back('3'); });
+        gate.set_value();
+
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+        while (pool.getStats().taskSize_ > 0 && chrono::steady_clock::now() < deadline)
+        {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        for (auto& tenant : pool.getTenantStats())
+        {
+            assert(tenant.taskSize_ == 0 && tenant.submittedSize_ >= tenant.completedSize_);
+        }
+    } // 析构时等待所有任务执行完
+
+    // 单线程按轮执行：每一轮租户1执行1个，租户2执行2个，租户3排在第一轮里
+    assert(order.size() == 201);
+    assert(order.find('3') < 4);
+    int count2 = (int)count(order.begin(), order.begin() + 150, '2');
+    assert(count2 >= 95 && count2 <= 105);
+
+    ThreadPool pool;
+    pool.start(4);
+    pool.setTenantMaxConcurrency(1, 1);
+    TaskOption capped;
+    capped.tenant_ = 1;
+    atomic_int running(0);
+    atomic_int maxRunning(0);
+    vector<future<void>> results;
+    for (int i = 0; i < 20; i++)
+    {
+        results.push_back(pool.submitTask(capped, [&running, &maxRunning]() {
+            int now = ++running;
+            int peak = maxRunning;
+            while (now > peak && !maxRunning.compare_exchange_weak(peak, now))
+            {
+            }
+            this_thread::sleep_for(chrono::milliseconds(2));
+            running--;
+        }));
+    }
+    for (auto& result : results)
+    {
+        result.get();
+    }
+    assert(maxRunning == 1);
+}
+
+// 并行算法：结果和标准算法一致，异常传给调用者，在线程池的任务里调用不会死锁
+void testParallel()
+{
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(100);
+    pool.start(4);
+
+    vector<atomic_int> visits(1000);
+    parallelFor(pool, visits.size(), [&visits](size_t block) { visits[block]++; });
+    assert(all_of(visits.begin(), visits.end(), [](const atomic_int& v) { return v == 1; }));
+    try
+    {
+        parallelFor(pool, 100, [](size_t block) {
+            if (block == 37)
+            {
+                throw runtime_error("block");
+            }
+        });
+        assert(false);
+    }
+    catch (const runtime_error&)
+    {
+    }
+
+    vector<long long> v(200000);
+    iota(v.begin(), v.end(), 1);
+    vector<long long> squares(v.size());
+    parallelTransform(pool, v.begin(), v.end(), squares.begin(), [](long long x) { return x * x; });
+    assert(squares[0] == 1 && squares.back() == 200000LL * 200000LL);
+
+    vector<long long> expected(v.size());
+    inclusive_scan(v.begin(), v.end(), expected.begin());
+    vector<long long> scanned(v);
+    assert(parallelInclusiveScan(pool, scanned.begin(), scanned.end(), scanned.begin()) == scanned.end());
+    assert(scanned == expected);
+
+    vector<long long> evens(v.size());
+    auto evensEnd = parallelCopyIf(pool, v.begin(), v.end(), evens.begin(), [](long long x) { return x % 2 == 0; });
+    evens.erase(evensEnd, evens.end());
+    assert(evens.size() == 100000 && evens.front() == 2 && evens.back() == 200000 && is_sorted(evens.begin(), evens.end()));
+    vector<long long> appended;
+    parallelCopyIf(pool, v.begin(), v.end(), back_inserter(appended), [](long long x) { return x % 2 == 0; });
+    assert(appended == evens);
+
+    vector<int> random(100000);
+    mt19937 rng(1);
+    generate(random.begin(), random.end(), [&rng]() { return (int)(rng() % 1000); });
+    auto sorted = random;
+    sort(sorted.begin(), sorted.end(), greater<int>());
+    auto result = pool.submitTask([&pool, &random]() {
+        parallelSort(pool, random.begin(), random.end(), greater<int>());
+    });
+    assert(result.wait_for(chrono::seconds(10)) == future_status::ready);
+    assert(random == sorted);
+}
+
+// whenAll/whenAny：组合future，whenAny可以取消其它任务，任务里可以检查是否被取消
+void testWhenAllAny()
+{
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(100);
+    pool.start(1);
+
+    vector<TaskFuture<int>> futures;
+    for (int i = 0; i < 20; i++)
+    {
+        futures.push_back(pool.submitTask([](int x) { return x * 2; }, i));
+    }
+    int sum = 0;
+    for (auto& future : whenAll(std::move(futures)).get())
+    {
+        sum += future.get();
+    }
+    assert(sum == 380);
+    auto both = whenAll(pool.submitTask([]() { return 1; }), pool.makeStrand()->submitTask([]() { return string("a"); })).get();
+    assert(get<0>(both).get() == 1 && get<1>(both).get() == "a");
+    assert(whenAll(vector<TaskFuture<int>>()).get().empty());
+    assert(whenAny(vector<TaskFuture<int>>()).get().index_ == 0);
+
+    // 单线程按顺序执行：第一个任务完成时在同一个线程上取消其它任务，它们都不会执行
+    // 先占住线程，whenAny注册完回调再开始执行
+    promise<void> gate;
+    shared_future<void> opened = gate.get_future().share();
+    pool.post([opened]() { opened.wait(); });
+    atomic_int ran(0);
+    vector<TaskFuture<int>> hedged;
+    hedged.push_back(pool.submitTask([]() { return 7; }));
+    for (int i = 0; i < 5; i++)
+    {
+        hedged.push_back(pool.submitTask([&ran]() { ran++; return 9; }));
+    }
+    auto any = whenAny(std::move(hedged), true);
+    gate.set_value();
+    auto first = any.get();
+    // 等线程丢弃完被取消的任务再检查它们的future
+    pool.submitTask([]() {}).get();
+    assert(first.index_ == 0 && first.futures_[0].get() == 7);
+    for (size_t i = 1; i < first.futures_.size(); i++)
+    {
+        try
+        {
+            first.futures_[i].get();
+            assert(false);
+        }
+        catch (const future_error& e)
+        {
+            assert(e.code() == future_errc::broken_promise);
+        }
+    }
+    assert(ran == 0);
+
+    // 已经开始执行的任务检查isCurrentTaskCancelled提前返回
+    auto running = pool.submitTask([]() {
+        int n = 0;
+        while (!ThreadPool::isCurrentTaskCancelled() && n < 5000)
+        {
+            this_thread::sleep_for(chrono::milliseconds(1));
+            n++;
+        }
+        return n;
+    });
+    this_thread::sleep_for(chrono::milliseconds(20));
+    running.cancel();
+    assert(running.get() < 5000);
+
+    // 不是来自线程池的future
+    try
+    {
+        vector<TaskFuture<int>> foreign(1);
+        whenAll(std::move(foreign));
+        assert(false);
+    }
+    catch (const invalid_argument&)
+    {
+    }
+}
+
+// 批量取任务：大量短任务都执行，长任务后面缓冲里的任务被空闲线程窃取
+void testTaskBatch()
+{
+    {
+        ThreadPool pool;
+        pool.setTaskQueMaxThreshHold(10000);
+        pool.setTaskBatchSize(16);
+        pool.start(4);
+        atomic<long> sum(0);
+        for (int i = 0; i < 20000; i++)
+        {
+            pool.post([&sum, i]() { sum += i; });
+        }
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+        while (sum != 19999L * 20000 / 2 && chrono::steady_clock::now() < deadline)
+        {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        assert(sum == 19999L * 20000 / 2);
+    }
+
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(1000);
+    pool.setTaskBatchSize(16);
+    pool.start(2);
+    vector<TaskFuture<int>> results;
+    for (int i = 0; i < 20; i++)
+    {
+        results.push_back(pool.submitTask([i]() {
+            if (i == 0)
+            {
+                this_thread::sleep_for(chrono::milliseconds(500));
+            }
+            return i;
+        }));
+    }
+    // 第一个任务执行时，它所在线程缓冲里的任务由另一个线程执行完
+    auto start = chrono::steady_clock::now();
+    for (int i = 1; i < 20; i++)
+    {
+        assert(results[i].get() == i);
+    }
+    assert(chrono::steady_clock::now() - start < chrono::milliseconds(400));
+    assert(results[0].get() == 0);
+    assert(pool.getStats().taskSize_ == 0);
+}
+
+// 运行中调整：resize增加线程立即创建，减少后多出来的线程执行完手里的任务退出，亲和到它们的任务不丢失
+void testResize()
+{
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(10000);
+    pool.start(2);
+    atomic_int done(0);
+    auto busy = [&done]() {
+        this_thread::sleep_for(chrono::milliseconds(2));
+        done++;
+    };
+    auto waitDone = [&done](int count) {
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+        while (done < count && chrono::steady_clock::now() < deadline)
+        {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        return done == count;
+    };
+    auto waitThreads = [&pool](int count) {
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+        while (pool.getStats().threadSize_ != count && chrono::steady_clock::now() < deadline)
+        {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        return pool.getStats().threadSize_ == count;
+    };
+
+    for (int i = 0; i < 100; i++)
+    {
+        pool.post(busy);
+    }
+    pool.resize(6);
+    assert(pool.getStats().threadSize_ == 6);
+    for (int i = 0; i < 100; i++)
+    {
+        pool.post(busy);
+    }
+
+    // 缩小时亲和到多余线程的任务也要执行完
+    pool.resize(1);
+    for (int i = 0; i < 100; i++)
+    {
+        pool.submitTask(i % 7, busy);
+    }
+    assert(waitDone(300));
+    assert(waitThreads(1));
+
+    pool.resize(3);
+    assert(pool.getStats().threadSize_ == 3);
+    for (int i = 0; i < 30; i++)
+    {
+        pool.post(busy);
+    }
+    assert(waitDone(330));
+
+    // cached模式下线程按任务增加，调回fixed模式后多出来的线程退出
+    pool.setThreadSizeMaxThreshHold(8);
+    pool.setMode(ThreadPoolMode::MODE_CACHED);
+    for (int i = 0; i < 100; i++)
+    {
+        pool.post(busy);
+    }
+    pool.setMode(ThreadPoolMode::MODE_FIXED);
+    assert(waitDone(430));
+    assert(waitThreads(3));
+}
+
+// 直接交给等待的线程：有空闲线程时提交的任务不进入任务队列，不计入taskSize_
+void testHandOff()
+{
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(10000);
+    pool.start(4);
+    this_thread::sleep_for(chrono::milliseconds(50));
+    for (int i = 0; i < 1000; i++)
+    {
+        // 至少有3个线程在等待，任务直接交出
+        auto result = pool.submitTask([i]() { return i; });
+        assert(pool.getStats().taskSize_ == 0);
+        assert(result.get() == i);
+    }
+
+    // 达到并发上限的租户不交出，和普通任务混在一起也不超过上限
+    pool.setTenantMaxConcurrency(1, 1);
+    TaskOption capped;
+    capped.tenant_ = 1;
+    atomic_int running(0);
+    atomic_int maxRunning(0);
+    atomic_int done(0);
+    for (int i = 0; i < 100; i++)
+    {
+        pool.post(capped, [&]() {
+            int now = ++running;
+            int peak = maxRunning;
+            while (now > peak && !maxRunning.compare_exchange_weak(peak, now))
+            {
+            }
+            this_thread::sleep_for(chrono::microseconds(200));
+            running--;
+            done++;
+        });
+        pool.post([&done]() { done++; });
+    }
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+    while (done < 200 && chrono::steady_clock::now() < deadline)
+    {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    assert(done == 200 && maxRunning == 1);
+}
+
+// 多个线程的任务记录写到各自的缓冲区，导出时全部合并
+void testProfiler()
+{
+    const int taskSize = 400;
+    ThreadPool pool;
+    pool.setTaskQueMaxThreshHold(taskSize);
+    pool.start(4);
+    pool.startProfiling();
+
+    TaskOption option;
+    option.label_ = "profiled";
+    vector<future<int>> futures;
+    for (int i = 0; i < taskSize; i++)
+    {
+        futures.push_back(pool.submitTask(option, [i]() { return i; }));
+    }
+    for (auto& f : futures)
+    {
+        f.get();
+    }
+    // 抛出异常的任务也有记录
+    pool.post(option, []() { throw runtime_error("profiled"); });
+    assert(waitFailedTasks(pool, 1));
+
+    auto countTasks = [&pool]() {
+        ostringstream out;
+        pool.exportTrace(out);
+        string trace = out.str();
+        size_t count = 0;
+        for (size_t pos = trace.find("\"cat\":\"task\""); pos != string::npos; pos = trace.find("\"cat\":\"task\"", pos + 1))
+        {
+            count++;
+        }
+        return count;
+    };
+    // future就绪之后任务才写记录，等待最后几个记录写完
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+    while (countTasks() < taskSize + 1 && chrono::steady_clock::now() < deadline)
+    {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    assert(countTasks() == taskSize + 1);
+
+    // 重新开始时清空所有线程的记录
+    pool.startProfiling();
+    assert(countTasks() == 0);
+}
+
+// start按树形创建初始线程，返回时所有线程都已经初始化完成
+void testStartTree()
+{
+    const int threadSize = 13;
+    mutex mtx;
+    set<int> inited;
+    ThreadPool pool;
+    pool.setWorkerInit([&mtx, &inited](int index) {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        lock_guard<mutex> lock(mtx);
+        inited.insert(index);
+    });
+    auto start = chrono::steady_clock::now();
+    pool.start(threadSize);
+    auto elapsed = chrono::steady_clock::now() - start;
+    {
+        lock_guard<mutex> lock(mtx);
+        assert((int)inited.size() == threadSize);
+    }
+    assert(pool.getStats().threadSize_ == threadSize);
+    // 初始化并行进行，远小于串行的13 * 20ms
+    assert(elapsed < chrono::milliseconds(threadSize * 20 / 2));
+}
+
+// 自定义策略的线程池上使用Strand、限流执行器、Reactor和并行算法
+void testPolicyPoolExecutors()
+{
+    BasicThreadPool<RingQueue<64>, SpinThenBlock<100>, FixedSize> pool;
+    pool.start(2);
+
+    auto strand = pool.makeStrand();
+    vector<int> order;
+    for (int i = 0; i < 100; i++)
+    {
+        strand->post([&order, i]() { order.push_back(i); });
+    }
+    strand->submitTask([]() {}).get();
+    assert(order.size() == 100 && is_sorted(order.begin(), order.end()));
+
+    auto limited = pool.limited(1);
+    assert(limited->submitTask([]() { return 7; }).get() == 7);
+    auto throttled = pool.rateLimited(1000, 10);
+    assert(throttled->submitTask([](int a) { return a * 2; }, 21).get() == 42);
+
+#ifdef __linux__
+    int fds[2];
+    assert(pipe(fds) == 0);
+    char buf[4] = { 0 };
+    auto read = pool.asyncRead(fds[0], buf, 3);
+    assert(pool.asyncWrite(fds[1], "abc", 3).get() == 3);
+    assert(read.get() == 3 && strcmp(buf, "abc") == 0);
+    close(fds[0]);
+    close(fds[1]);
+#endif
+
+    vector<int> v(100000);
+    iota(v.rbegin(), v.rend(), 0);
+    parallelSort(pool, v.begin(), v.end());
+    assert(is_sorted(v.begin(), v.end()) && v.front() == 0);
+}
+
+// 有界队列满时内部提交的任务(限流执行器、Strand)放进溢出队列，不丢弃，按顺序执行
+void testRingQueueOverflow()
+{
+    BasicThreadPool<RingQueue<2>, BlockingWait, FixedSize> pool;
+    pool.start(1);
+    promise<void> gate;
+    shared_future<void> opened = gate.get_future().share();
+    pool.post([opened]() { opened.wait(); });
+
+    auto limited = pool.limited(100);
+    atomic_int count(0);
+    for (int i = 0; i < 50; i++)
+    {
+        limited->post([&count]() { count++; });
+    }
+    auto strand = pool.makeStrand();
+    vector<int> order;
+    for (int i = 0; i < 50; i++)
+    {
+        strand->post([&order, i]() { order.push_back(i); });
+    }
+    auto last = strand->submitTask([]() {});
+    gate.set_value();
+
+    last.get();
+    assert(order.size() == 50 && is_sorted(order.begin(), order.end()));
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+    while ((count < 50 || pool.getStats().taskSize_ != 0) && chrono::steady_clock::now() < deadline)
+    {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    assert(count == 50 && pool.getStats().taskSize_ == 0);
+}
+
+// Watchdog：共享线程交替执行两个线程池的任务，每个线程在每个Watchdog上只注册一个心跳
+// 启用共享线程后不能关闭，放在最后执行
+void testWatchdogSharedScheduler()
+{
+    ThreadPool::useSharedScheduler(2);
+    ThreadPool poolA;
+    ThreadPool poolB;
+    poolA.start(2);
+    poolB.start(2);
+    auto ignore = [](int, const char*, chrono::milliseconds) {};
+    poolA.startWatchdog(chrono::seconds(10), ignore);
+    poolB.startWatchdog(chrono::seconds(10), ignore);
+
+    Watchdog watchdogA(poolA);
+    Watchdog watchdogB(poolB);
+    for (int i = 0; i < 1000; i++)
+    {
+        poolA.submitTask(watchdogA.wrap([]() {}, "a")).get();
+        poolB.submitTask(watchdogB.wrap([]() {}, "b")).get();
+    }
+    assert(watchdogA.heartbeatSize() <= 2);
+    assert(watchdogB.heartbeatSize() <= 2);
+
+    // 线程退出后心跳被删除
+    size_t before = watchdogA.heartbeatSize();
+    thread([&]() { watchdogA.wrap([]() {}, "exit")(); }).join();
+    assert(watchdogA.heartbeatSize() == before);
+}
+
+// 共享线程：两个线程池都有积压时按权重分配共享线程
+// 在testWatchdogSharedScheduler之后执行，共享线程已经启用
+void testSharedSchedulerWeight()
+{
+    ThreadPool poolA;
+    ThreadPool poolB;
+    poolA.setTaskQueMaxThreshHold(10000);
+    poolB.setTaskQueMaxThreshHold(10000);
+    poolB.setWeight(3);
+    poolA.start(2);
+    poolB.start(2);
+
+    // 先占住共享线程，两个线程池的任务都排好队再开始执行
+    promise<void> gate;
+    shared_future<void> opened = gate.get_future().share();
+    vector<future<void>> blockers;
+    for (int i = 0; i < 2; i++)
+    {
+        blockers.push_back(poolA.submitTask([opened]() { opened.wait(); }));
+    }
+    this_thread::sleep_for(chrono::milliseconds(50));
+
+    mutex mtx;
+    string order;
+    const int taskSize = 1000;
+    for (int i = 0; i < taskSize; i++)
+    {
+        poolA.post([&mtx, &order]() {
+            lock_guard<mutex> lock(mtx);
+            order.push_back('a');
+        });
+        poolB.post([&mtx, &order]() {
+            lock_guard<mutex> lock(mtx);
+            order.push_back('b');
+        });
+    }
+    gate.set_value();
+    for (auto& blocker : blockers)
+    {
+        blocker.get();
+    }
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+    for (;;)
+    {
+        {
+            lock_guard<mutex> lock(mtx);
+            if ((int)order.size() == 2 * taskSize || chrono::steady_clock::now() > deadline)
+            {
+                break;
+            }
+        }
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    // 前一半两个线程池都还有积压，poolB执行的任务大约是poolA的3倍
+    lock_guard<mutex> lock(mtx);
+    assert((int)order.size() == 2 * taskSize);
+    int countB = (int)count(order.begin(), order.begin() + taskSize, 'b');
+    int countA = taskSize - countB;
+    assert(countA > 0 && countB > 2 * countA);
+}
+
 int main()
 {
+#ifdef __linux__
+    testShmRoundTrip();
+    testShmReclaim();
+    cout << "shm tests passed" << endl;
+
+    for (bool useIoUring : { true, false })
+    {
+        testReactorFile(useIoUring);
+        testReactorPipe(useIoUring);
+        testReactorSocket(useIoUring);
+        testReactorStop(useIoUring);
+    }
+    cout << "reactor tests passed" << endl;
+#endif
+
+    testStrandOrder();
+    testAffinity();
+    testBlockingSection();
+    testWorkerLocal();
+    testTaskCost();
+    testTenants();
+    testParallel();
+    testWhenAllAny();
+    testTaskBatch();
+    testResize();
+    testHandOff();
+    testProfiler();
+    testStartTree();
+    cout << "feature tests passed" << endl;
+
+    testPolicyPoolExecutors();
+    testRingQueueOverflow();
+    cout << "policy pool tests passed" << endl;
+
+    testPostException();
+    testLimitedException();
+    testRateLimitedDropped();
+    testWatchdogException();
+    cout << "exception tests passed" << endl;
+
     ThreadPool pool;
     //pool.setMode(ThreadPoolMode::MODE_CACHED);
     pool.start(2);
@@ -57,6 +1292,11 @@ int main()
 	cout << res4.get() << endl;
 	cout << res5.get() << endl;
 
+    testWatchdogSharedScheduler();
+    cout << "watchdog tests passed" << endl;
+    testSharedSchedulerWeight();
+    cout << "shared scheduler tests passed" << endl;
+
     //packaged_task<int(int, int)> task(sum1);
     //// future <=> Result
     //future<int> res = task.get_future();
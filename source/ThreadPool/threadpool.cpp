@@ -1,203 +1,397 @@
 #include "threadpool.h"
 
-const int TASK_MAX_THRESHHOLD = 2;//INT32_MAX;
-const int THREAD_MAX_THRESHHOLD = 1024;
-const int THREAD_MAX_IDLE_TIME = 60; // λs
+#ifdef __linux__
+#include <pthread.h>
+#include <limits.h>
+#endif
+
+// 当前线程所属的线程池，不是线程池的线程时为nullptr
+static thread_local ThreadPoolBase* currentThreadPool = nullptr;
+// 当前线程在线程池里的编号，不是线程池的线程时为-1
+static thread_local int currentIndex = -1;
+// 当前线程正在执行的submitTask任务，用来检查是否被取消
+static thread_local TaskCompletion* currentCompletion = nullptr;
+
+// 默认策略的线程池
+template class BasicThreadPool<>;
+
+//---------------------------ThreadPoolBase方法实现-------------------
+// 启用共享线程
+void ThreadPoolBase::useSharedScheduler(int threadSize)
+{
+	Scheduler::instance().start(threadSize);
+}
 
-ThreadPool::ThreadPool() : initThreadSize_(0), taskSize_(0), curThreadSize_(0), idleThreadSize_(0), threadSizeThreshHold_(THREAD_MAX_THRESHHOLD), taskQueMaxThreshHold_(TASK_MAX_THRESHHOLD), poolMode_(ThreadPoolMode::MODE_FIXED), isPoolRunning_(false)
+int ThreadPoolBase::currentWorkerIndex()
 {
+	return currentIndex;
+}
 
+void ThreadPoolBase::setCurrentWorkerIndex(int index)
+{
+	currentIndex = index;
 }
 
-// ̳߳
-void ThreadPool::start(int initThreadSize)
+ThreadPoolBase* ThreadPoolBase::currentPool()
 {
-	// ̳߳ص״̬
-	isPoolRunning_ = true;
+	return currentThreadPool;
+}
 
-	// ¼ʼ̸߳
-	initThreadSize_ = initThreadSize;
-	curThreadSize_ = initThreadSize;
+void ThreadPoolBase::setCurrentPool(ThreadPoolBase* pool)
+{
+	currentThreadPool = pool;
+}
 
-	// ̶߳
-	for (int i = 0; i < initThreadSize_; i++)
-	{
-		// thread̶߳ʱ̺߳thread̶߳
-		//threads_.emplace_back(new Thread(std::bind(&ThreadPool::threadFunc, this))); // ֱʹָҪֶɾ ڴй© ʹָԶ
-		std::unique_ptr<Thread> uptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-		int threadId = uptr->getThreadId();
-		threads_.emplace(threadId, std::move(uptr));
-		//threads_.emplace_back(std::move(uptr)); // unique_ptrʹֵ죬ֵ 
-	}
+// 当前任务是否已经被取消
+bool ThreadPoolBase::isCurrentTaskCancelled()
+{
+	return currentCompletion != nullptr && currentCompletion->isCancelled();
+}
+
+TaskCompletion* ThreadPoolBase::exchangeCurrentCompletion(TaskCompletion* completion)
+{
+	TaskCompletion* outer = currentCompletion;
+	currentCompletion = completion;
+	return outer;
+}
+
+// 声明阻塞区
+ThreadPoolBase::BlockingSection ThreadPoolBase::blockingSection()
+{
+	// 只有线程池自己的线程阻塞时才需要补偿
+	return BlockingSection(currentPool() == this ? this : nullptr);
+}
 
-	// ߳	std::vector<Thread*> threads_;
-	for (int i = 0; i < initThreadSize_; i++)
+//---------------------------线程方法实现-------------------
+std::atomic_int Thread::generateId_(0);
+
+Thread::Thread(ThreadFunc func) : func_(func), threadId_(generateId_++), stackSize_(0)
+{
+
+}
+
+// 设置栈大小
+void Thread::setStackSize(size_t stackSize)
+{
+	stackSize_ = stackSize;
+}
+
+// 启动线程
+void Thread::start()
+{
+#ifdef __linux__
+	// 指定了栈大小时用pthread属性创建分离线程，失败时退回std::thread
+	if (stackSize_ > 0)
 	{
-		threads_[i]->start();
-		idleThreadSize_++; // ¼ʼ̵߳
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setstacksize(&attr, std::max(stackSize_, (size_t)PTHREAD_STACK_MIN));
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		auto arg = new std::pair<ThreadFunc, int>(func_, threadId_);
+		pthread_t tid;
+		int err = pthread_create(&tid, &attr, &Thread::entry, arg);
+		pthread_attr_destroy(&attr);
+		if (err == 0)
+		{
+			return;
+		}
+		delete arg;
 	}
+#endif
+	// 创建一个线程来执行一个线程函数
+	std::thread t(func_, threadId_); // C++11 线程对象t 和 线程函数func_
+	// 设置分离线程 pthread_detach
+	t.detach();
+}
+
+int Thread::getThreadId() const
+{
+	return threadId_;
+}
 
+// 设置当前线程的名称		Linux下最长15个字符，超出的部分截掉
+void Thread::setCurrentName(const std::string& name)
+{
+#ifdef __linux__
+	pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#endif
 }
 
-// ̳߳ģʽ
-void ThreadPool::setMode(ThreadPoolMode mode)
+#ifdef __linux__
+// pthread线程入口
+void* Thread::entry(void* arg)
+{
+	std::unique_ptr<std::pair<ThreadFunc, int>> func(static_cast<std::pair<ThreadFunc, int>*>(arg));
+	func->first(func->second);
+	return nullptr;
+}
+#endif
+
+
+//---------------------------TaskCompletion方法实现-------------------
+TaskCompletion::TaskCompletion() : isDone_(false), isCancelled_(false)
+{
+
+}
+
+void TaskCompletion::onComplete(std::function<void()> callback)
 {
-	if (checkRunningState())
 	{
-		return;
+		std::lock_guard<std::mutex> lock(mtx_);
+		if (!isDone_)
+		{
+			callbacks_.emplace_back(std::move(callback));
+			return;
+		}
 	}
-	poolMode_ = mode;
+	callback();
 }
 
-// taskֵ
-void ThreadPool::setTaskQueMaxThreshHold(int threshhold)
+void TaskCompletion::complete()
 {
-	if (checkRunningState())
+	// 回调里可能注册新的回调或者释放持有completion的对象，不持有锁调用
+	std::vector<std::function<void()>> callbacks;
 	{
-		return;
+		std::lock_guard<std::mutex> lock(mtx_);
+		isDone_ = true;
+		callbacks.swap(callbacks_);
 	}
-	taskQueMaxThreshHold_ = threshhold;
+	for (auto& callback : callbacks)
+	{
+		callback();
+	}
+}
+
+
+//---------------------------Strand方法实现-------------------
+const int STRAND_MAX_BATCH = 64; // Strand每次调度最多连续执行的任务数量
+
+Strand::Strand(ThreadPoolBase& pool) : pool_(pool), isScheduled_(false)
+{
+
 }
 
-// ̳߳cachedģʽֵ߳
-void ThreadPool::setThreadSizeMaxThreshHold(int threadthreshhold)
+void Strand::postTask(Task task)
 {
-	if (checkRunningState())
 	{
-		return;
+		std::lock_guard<std::mutex> lock(taskQueMtx_);
+		taskQue_.emplace(std::move(task));
+		if (isScheduled_)
+		{
+			// 已经有drain任务在排队或者执行，它会按顺序执行到这个任务
+			return;
+		}
+		isScheduled_ = true;
 	}
-	if (poolMode_ == ThreadPoolMode::MODE_CACHED)
+	schedule();
+}
+
+void Strand::schedule()
+{
+	// drain任务持有Strand的shared_ptr，保证执行期间Strand不会被析构
+	// 每个Strand同时最多只有一个drain任务，不受任务队列上限的限制
+	auto self = shared_from_this();
+	TaskOption option;
+	option.label_ = "strand";
+	pool_.scheduleTask([self]() { self->drain(); }, option);
+}
+
+void Strand::drain()
+{
+	for (int i = 0; ; i++)
 	{
-		threadSizeThreshHold_ = threadthreshhold;
+		Task task;
+		{
+			std::lock_guard<std::mutex> lock(taskQueMtx_);
+			if (taskQue_.empty())
+			{
+				// 队列空了，下一次post重新调度
+				isScheduled_ = false;
+				return;
+			}
+
+			if (i == STRAND_MAX_BATCH)
+			{
+				// 连续执行了足够多的任务，让出线程，重新排到线程池队列的末尾，避免饿死其它任务
+				break;
+			}
+
+			task = std::move(taskQue_.front());
+			taskQue_.pop();
+		} // 执行任务之前释放锁
+
+		try
+		{
+			task();
+		}
+		catch (...)
+		{
+			// isScheduled_还是true，不重新调度的话后面的任务再也不会执行
+			schedule();
+			throw;
+		}
 	}
+
+	schedule();
+}
+
+
+//---------------------------ThrottledExecutor方法实现-------------------
+ThrottledExecutor::ThrottledExecutor(ThreadPoolBase& pool, int maxConcurrent, double tasksPerSec, int burst)
+	: pool_(pool)
+	, maxConcurrent_(maxConcurrent)
+	, tokenInterval_(tasksPerSec > 0 ? std::max<int64_t>(1, (int64_t)(1e9 / tasksPerSec)) : 0)
+	, burstTime_(tokenInterval_ * burst)
+	, tokenTime_(std::chrono::steady_clock::now() - burstTime_) // 开始时令牌桶是满的
+	, runningSize_(0)
+	, isWaitingToken_(false)
+{
+
+}
+
+int ThrottledExecutor::pendingTaskSize() const
+{
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	return taskQue_.size();
 }
 
-// ̺߳		̳߳ص̴߳
-// ̺߳أӦ߳Ҳͽ
-void ThreadPool::threadFunc(int threadid)
+int ThrottledExecutor::runningTaskSize() const
 {
-	auto lastTime = std::chrono::high_resolution_clock().now();
+	std::lock_guard<std::mutex> lock(taskQueMtx_);
+	return runningSize_;
+}
 
-	//while(isPoolRunning_)
-	// ִɣ̳߳زſԻ߳Դ
+void ThrottledExecutor::postTask(Task task)
+{
+	{
+		std::lock_guard<std::mutex> lock(taskQueMtx_);
+		taskQue_.emplace(std::move(task));
+	}
+	dispatch();
+}
+
+void ThrottledExecutor::dispatch()
+{
 	for (;;)
 	{
 		Task task;
+		std::chrono::nanoseconds wait(0);
 		{
-			// ȡ
-			std::unique_lock<std::mutex> lock(taskQueMtx_);
-
-			std::cout << "tid: " << std::this_thread::get_id() << "Իȡ..." << std::endl;
+			std::lock_guard<std::mutex> lock(taskQueMtx_);
+			// 已经在等令牌时由定时线程继续，并发达到上限时由执行完的任务继续
+			if (taskQue_.empty() || isWaitingToken_ || (maxConcurrent_ > 0 && runningSize_ >= maxConcurrent_))
+			{
+				return;
+			}
 
-			// cachedģʽ£пѾ˺̣ܶ߳ǿʱ䳬60s߳̽
-			// initThreadSize_߳Ҫл
-			// ǰʱ - һִ߳еʱ > 60s
+			if (tokenInterval_.count() > 0)
+			{
+				wait = acquireToken(std::chrono::steady_clock::now());
+			}
+			if (wait.count() > 0)
+			{
+				isWaitingToken_ = true;
+			}
+			else
+			{
+				runningSize_++;
+				task = std::move(taskQue_.front());
+				taskQue_.pop();
+			}
+		} // 放入线程池之前释放锁
 
-			// ÿһзһ ֣ʱ  ִз
-			//  + ˫ж 
-			while (taskQue_.size() == 0)
+		auto self = shared_from_this();
+		if (wait.count() > 0)
+		{
+			// 等待期间不占用线程池的线程，到时间在定时线程上继续放入
+			// 线程池停止时定时任务没有执行就被析构，丢弃还在等待的任务，否则它们的future永远不会就绪
+			struct TokenWaiter
 			{
-				// ̳߳Ҫ߳Դ   1.poolֳȻȡ  2.̳߳߳Ȼȡ
-				if (!isPoolRunning_)
+				TokenWaiter(std::shared_ptr<ThrottledExecutor> executor) : executor_(std::move(executor))
 				{
-					threads_.erase(threadid);
-					std::cout << "threadid: " << std::this_thread::get_id() << " exit!" << std::endl;
-					exitCond_.notify_all();
-					return; // ̺߳߳̽
 				}
 
-				if (poolMode_ == ThreadPoolMode::MODE_CACHED)
+				// 移动后executor_为空，被移动的对象析构时不丢弃任务
+				TokenWaiter(TokenWaiter&&) = default;
+
+				~TokenWaiter()
 				{
-					// ʱ
-					if (std::cv_status::timeout == notEmpty_.wait_for(lock, std::chrono::seconds(1)))
+					if (executor_ != nullptr)
 					{
-						auto nowTime = std::chrono::high_resolution_clock().now();
-						auto during = std::chrono::duration_cast<std::chrono::seconds>(nowTime - lastTime);
-						if (during.count() >= THREAD_MAX_IDLE_TIME && curThreadSize_ > initThreadSize_) // 򽫻߳
-						{
-							// ʼ߳
-							// ¼߳رֵ޸
-							// ̶߳߳бɾ		ûа취ȷ threadFunc = thread
-							// threadId => thread => ɾ
-							threads_.erase(threadid);
-							curThreadSize_--;
-							idleThreadSize_--;
-
-							std::cout << "threadid: " << std::this_thread::get_id() << " exit!" << std::endl;
-							return;
-						}
+						executor_->dropTasks();
 					}
 				}
-				else
+
+				void operator()()
 				{
-					// ȴnotEmpty_
-					notEmpty_.wait(lock); // [&]()->bool { return taskQue_.size() > 0; } lambdaʽж
+					std::shared_ptr<ThrottledExecutor> executor(std::move(executor_));
+					{
+						std::lock_guard<std::mutex> lock(executor->taskQueMtx_);
+						executor->isWaitingToken_ = false;
+					}
+					executor->dispatch();
 				}
-			}
-
-			idleThreadSize_--;
 
-			std::cout << "tid: " << std::this_thread::get_id() << "Իȡɹ..." << std::endl;
-
-			// ȡһ
-			task = taskQue_.front();
-			taskQue_.pop();
-			taskSize_--;
+				std::shared_ptr<ThrottledExecutor> executor_;
+			};
+			pool_.postAfter(std::chrono::steady_clock::now() + wait, TokenWaiter(self));
+			return;
+		}
 
-			// Ȼʣ񣬼ִ֪ͨ߳
-			if (taskQue_.size() > 0)
+		// 任务持有执行器的shared_ptr，执行完归还名额并放入下一个任务
+		// 任务抛出异常时名额也要归还，否则并发上限永久少一个
+		struct FinishGuard
+		{
+			~FinishGuard()
 			{
-				notEmpty_.notify_all();
+				executor_->finishTask();
 			}
 
-			// ȡ󣬽֪ͨԼύ
-			notFull_.notify_all();
-		} // ͷŵ
+			std::shared_ptr<ThrottledExecutor> executor_;
+		};
 
-		// ǰ̸ָ߳
-		if (task != nullptr)
-		{
-			task(); // ִfunction<void(int)>
-		}
-		idleThreadSize_++;
-		lastTime = std::chrono::high_resolution_clock().now(); // ִ߳ʱ
+		// 已经拿到执行名额，不受任务队列上限的限制
+		TaskOption option;
+		option.label_ = "throttled";
+		pool_.scheduleTask([self, task = std::move(task)]() mutable {
+			FinishGuard guard{ self };
+			task();
+		}, option);
 	}
 }
 
-bool ThreadPool::checkRunningState() const
-{
-	return isPoolRunning_;
-}
-
-ThreadPool::~ThreadPool()
-{
-	isPoolRunning_ = false;
-	//notEmpty_.notify_all();
-
-	// ȴ̷̳߳߳ ״̬ & ִ
-	std::unique_lock<std::mutex> lock(taskQueMtx_);
-	notEmpty_.notify_all();
-	exitCond_.wait(lock, [&]()->bool { return threads_.size() == 0; });
-}
-
-//---------------------------̷߳ʵ-------------------
-int Thread::generateId_ = 0;
-
-Thread::Thread(ThreadFunc func) : func_(func), threadId_(generateId_++)
+void ThrottledExecutor::finishTask()
 {
-
+	{
+		std::lock_guard<std::mutex> lock(taskQueMtx_);
+		runningSize_--;
+	}
+	dispatch();
 }
 
-// ߳
-void Thread::start()
+void ThrottledExecutor::dropTasks()
 {
-	// һִ߳һ̺߳
-	std::thread t(func_, threadId_); // C++11 ̶߳t  ̺߳func_
-	// ÷߳ pthread_detach
-	t.detach();
+	std::queue<Task> dropped;
+	{
+		std::lock_guard<std::mutex> lock(taskQueMtx_);
+		dropped.swap(taskQue_);
+		isWaitingToken_ = false;
+	}
+	// 任务析构时通知completion，可能调用whenAll的回调，不持有锁析构
 }
 
-int Thread::getThreadId() const
+// 令牌桶按时间计算		不需要定时补充令牌
+std::chrono::nanoseconds ThrottledExecutor::acquireToken(std::chrono::steady_clock::time_point now)
 {
-	return threadId_;
+	// 令牌最多攒burst个
+	if (now - tokenTime_ > burstTime_)
+	{
+		tokenTime_ = now - burstTime_;
+	}
+	if (now - tokenTime_ < tokenInterval_)
+	{
+		return tokenInterval_ - (now - tokenTime_);
+	}
+	tokenTime_ += tokenInterval_;
+	return std::chrono::nanoseconds(0);
 }
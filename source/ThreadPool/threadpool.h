@@ -4,6 +4,7 @@
 #include <iostream>
 #include <vector>
 #include <queue>
+#include <deque>
 #include <memory>
 #include <atomic>
 #include <mutex>
@@ -12,35 +13,414 @@
 #include <thread>
 #include <unordered_map>
 #include <future>
+#include <ostream>
+#include <algorithm>
+#include <tuple>
+#include <type_traits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <map>
+#ifdef __linux__
+#include <sys/types.h>
+#endif
+
+#include "poolpolicy.h"
+#include "profiler.h"
+#include "watchdog.h"
 
 
-// ֵ̳֧߳ģʽ
+// 线程池支持的模式
 enum class ThreadPoolMode
 {
-	MODE_FIXED, // ̸߳ǹ̶
-	MODE_CACHED // ̸߳ǿɶ̬
+	MODE_FIXED, // 线程个数是固定不变
+	MODE_CACHED // 线程个数是可动态增长
+};
+
+// 任务类型 =》只能移动的函数对象
+// 和std::function<void()>不同，可以保存packaged_task、捕获了unique_ptr的lambda等只能移动的对象
+class Task
+{
+public:
+	Task() = default;
+	~Task() = default;
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+	Task(Task&&) = default;
+	Task& operator=(Task&&) = default;
+
+	// 这个构造函数可以让Task接收任意可调用对象
+	template<typename Func, typename = std::enable_if_t<!std::is_same<std::decay_t<Func>, Task>::value>>
+	Task(Func&& func) : base_(std::make_unique<Derive<std::decay_t<Func>>>(std::forward<Func>(func)))
+	{
+	}
+
+	// 执行任务
+	void operator()()
+	{
+		base_->run();
+	}
+
+	explicit operator bool() const
+	{
+		return base_ != nullptr;
+	}
+
+private:
+	// 基类类型
+	class Base
+	{
+	public:
+		virtual ~Base() = default;
+		virtual void run() = 0;
+	};
+
+	// 派生类类型
+	template<typename Func>
+	class Derive : public Base
+	{
+	public:
+		Derive(Func&& func) : func_(std::move(func))
+		{
+		}
+		Derive(const Func& func) : func_(func)
+		{
+		}
+		void run() override
+		{
+			func_();
+		}
+		Func func_; // 保存的可调用对象
+	};
+
+private:
+	std::unique_ptr<Base> base_;
+};
+
+// 任务函数用参数调用后的返回值类型
+template<typename Func, typename... Args>
+using TaskResult = std::invoke_result_t<std::decay_t<Func>, std::decay_t<Args>...>;
+
+// 把函数和参数按值保存起来(decay-copy，右值参数只移动不拷贝)，返回一个无参的可调用对象
+// 执行时把保存的参数以右值传给函数，语义和std::thread相同，可以传递unique_ptr等只能移动的参数
+template<typename Func, typename... Args>
+auto bindTask(Func&& func, Args&&... args)
+{
+	return [func = std::forward<Func>(func), args = std::tuple<std::decay_t<Args>...>(std::forward<Args>(args)...)]() mutable -> TaskResult<Func, Args...>
+	{
+		return std::apply(std::move(func), std::move(args));
+	};
+}
+
+// 提交任务的选项
+struct TaskOption
+{
+	const char* label_ = nullptr; // 任务名称，性能分析时显示，必须是字符串常量或者生命周期足够长
+	bool hasAffinity_ = false; // 是否按affinityKey_选择线程
+	size_t affinityKey_ = 0; // 亲和性key，见submitTask(affinityKey, ...)
+	size_t cost_ = 0; // 任务的开销，比如参数占用的字节数，见setTaskQueMaxCost
+	int tenant_ = 0; // 任务所属的租户，见setTenantWeight
+};
+
+// 任务完成通知		submitTask返回的TaskFuture和执行任务的线程共享
+// 任务执行完、被取消或者提交失败时完成，whenAll/whenAny在这里注册回调，不需要阻塞在get()上
+class TaskCompletion
+{
+public:
+	TaskCompletion();
+	~TaskCompletion() = default;
+
+	TaskCompletion(const TaskCompletion&) = delete;
+	TaskCompletion& operator=(const TaskCompletion&) = delete;
+
+	// 注册完成后调用的回调，已经完成时立即在当前线程调用
+	// 回调在完成任务的线程上执行，应该很短，不能阻塞
+	void onComplete(std::function<void()> callback);
+
+	// 标记完成，按注册顺序调用所有回调
+	void complete();
+
+	// 取消：还没有开始执行的任务不再执行
+	void cancel()
+	{
+		isCancelled_ = true;
+	}
+
+	bool isCancelled() const
+	{
+		return isCancelled_;
+	}
+
+private:
+	std::mutex mtx_; // 保护isDone_和callbacks_
+	bool isDone_;
+	std::vector<std::function<void()>> callbacks_;
+	std::atomic_bool isCancelled_;
+};
+
+// 线程池返回的future		可以当作std::future使用，也可以交给whenAll/whenAny组合
+template<typename R>
+class TaskFuture : public std::future<R>
+{
+public:
+	TaskFuture() = default;
+
+	TaskFuture(std::future<R>&& future, std::shared_ptr<TaskCompletion> completion)
+		: std::future<R>(std::move(future)), completion_(std::move(completion))
+	{
+	}
+
+	// 取消任务：还没有开始执行的任务不再执行，get()抛出future_error(broken_promise)
+	// 已经开始执行的任务照常执行完，任务里可以用ThreadPool::isCurrentTaskCancelled()检查后提前返回
+	void cancel()
+	{
+		if (completion_ != nullptr)
+		{
+			completion_->cancel();
+		}
+	}
+
+	const std::shared_ptr<TaskCompletion>& completion() const
+	{
+		return completion_;
+	}
+
+private:
+	std::shared_ptr<TaskCompletion> completion_;
+};
+
+// 线程池的统计数据
+struct ThreadPoolStats
+{
+	int threadSize_; // 当前线程数量
+	int idleThreadSize_; // 空闲线程数量
+	int taskSize_; // 排队的任务数量
+	size_t queuedCost_; // 排队任务的开销之和
+	size_t peakQueuedCost_; // 排队任务的开销之和的最大值
+	uint64_t failedTaskSize_; // 抛出异常的任务数量(submitTask的任务的异常在future里，不计入)
 };
 
-// ߳
+// 一个租户的统计数据
+// completedSize_是累计值，两次获取的差除以时间间隔就是这段时间的吞吐量
+struct TenantStats
+{
+	int tenant_; // 租户ID
+	int taskSize_; // 排队的任务数量
+	int runningSize_; // 正在执行的任务数量
+	uint64_t submittedSize_; // 累计提交的任务数量
+	uint64_t completedSize_; // 累计执行完的任务数量
+};
+
+// 线程类型
 class Thread
 {
 public:
-	// ̺߳
+	// 线程函数对象类型
 	using ThreadFunc = std::function<void(int)>;
 
 	Thread(ThreadFunc func);
 	~Thread() = default;
 
-	// ߳
+	// 设置栈大小，0表示使用系统默认值，start之前调用
+	void setStackSize(size_t stackSize);
+
+	// 启动线程
 	void start();
 
-	// ȡ߳ID
+	// 获取线程ID
 	int getThreadId() const;
 
+	// 设置当前线程的名称，调试器和top里显示
+	static void setCurrentName(const std::string& name);
+
+private:
+#ifdef __linux__
+	// pthread线程入口，arg是new出来的线程函数和线程ID
+	static void* entry(void* arg);
+#endif
+
 private:
-	ThreadFunc func_; // ̺߳
-	static int generateId_;
+	ThreadFunc func_; // 线程函数对象
+	static std::atomic_int generateId_; // 多个线程池可能同时创建线程
 	int threadId_;
+	size_t stackSize_; // 栈大小，0表示默认值
+};
+
+class Strand;
+class ThrottledExecutor;
+class Reactor;
+class Scheduler;
+
+// 线程池和策略无关的部分		当前线程的状态，共享线程Scheduler和看门狗Watchdog通过它访问不同策略的线程池
+class ThreadPoolBase
+{
+public:
+	virtual ~ThreadPoolBase() = default;
+
+	// 启用进程内共享的线程集合，只有第一次调用有效
+	// 之后start的线程池不再创建自己的线程，任务交给共享线程执行，调用者的代码不需要修改
+	// start的参数变成这个线程池同时占用共享线程的上限，cached模式下上限为setThreadSizeMaxThreshHold的值
+	// 任务队列上限、亲和性、Strand、Reactor照常使用，亲和性key不再绑定线程
+	// 共享线程上的blockingSection不创建补偿线程
+	static void useSharedScheduler(int threadSize = std::thread::hardware_concurrency());
+
+	// 当前线程在线程池里的编号，不是线程池的线程时返回-1
+	// 编号从0开始连续分配，线程退出后编号给新线程复用，同一时刻不超过线程数量
+	// 共享线程模式下是共享线程的编号
+	static int currentWorkerIndex();
+
+	// 当前任务是否已经被取消(TaskFuture::cancel)，不是在执行submitTask提交的任务时返回false
+	// 执行时间长的任务可以定期检查，提前返回
+	static bool isCurrentTaskCancelled();
+
+	// 提交不需要返回值的任务，任务队列满或者线程池没有启动时最多等待timeout，仍然不能提交时返回false
+	// 和post不同，失败时调用者拿回处理的机会，比如ShmServer的分发线程检查是否停止后重试
+	template<typename Func, typename... Args>
+	bool tryPostFor(std::chrono::milliseconds timeout, Func&& func, Args&&... args)
+	{
+		Task task(bindTask(std::forward<Func>(func), std::forward<Args>(args)...));
+		return scheduleTaskFor(task, timeout);
+	}
+
+	// 阻塞区		在线程池的任务里，执行阻塞的IO或者等待锁之前声明，让线程池临时创建补偿线程
+	// 阻塞区结束后多余的补偿线程退出，fixed和cached模式都适用
+	class BlockingSection
+	{
+	public:
+		~BlockingSection()
+		{
+			if (pool_ != nullptr)
+			{
+				pool_->leaveBlocking();
+			}
+		}
+
+		BlockingSection(const BlockingSection&) = delete;
+		BlockingSection& operator=(const BlockingSection&) = delete;
+
+	private:
+		friend class ThreadPoolBase;
+
+		BlockingSection(ThreadPoolBase* pool) : pool_(pool)
+		{
+			if (pool_ != nullptr)
+			{
+				pool_->enterBlocking();
+			}
+		}
+
+		ThreadPoolBase* pool_; // 不是线程池的线程调用时为nullptr，什么也不做
+	};
+
+	/*
+	example:
+	pool.submitTask([&]() {
+		auto guard = pool.blockingSection();
+		read(fd, buf, len);
+	});
+	*/
+	// 声明当前线程将要阻塞，返回的对象析构时阻塞结束
+	BlockingSection blockingSection();
+
+protected:
+	friend class Scheduler;
+	friend class Watchdog;
+	friend class Strand;
+	friend class ThrottledExecutor;
+	friend class Reactor;
+
+	// 包装packaged_task：执行前检查是否已经取消，执行后通知completion
+	// 取消的任务不执行，packaged_task析构，future得到broken_promise
+	// 没有执行就被析构(线程池停止时丢弃的任务、限流执行器里没等到令牌的任务)也通知completion，whenAll/whenAny不会一直等待
+	template<typename R>
+	class CompletionTask
+	{
+	public:
+		CompletionTask(std::packaged_task<R()> task, std::shared_ptr<TaskCompletion> completion)
+			: task_(std::move(task)), completion_(std::move(completion))
+		{
+		}
+
+		// 移动后completion_为空，被移动的对象析构时不再通知
+		CompletionTask(CompletionTask&&) = default;
+
+		~CompletionTask()
+		{
+			if (completion_ != nullptr)
+			{
+				drop();
+			}
+		}
+
+		void operator()()
+		{
+			if (completion_->isCancelled())
+			{
+				drop();
+				return;
+			}
+
+			TaskCompletion* outer = exchangeCurrentCompletion(completion_.get());
+			task_();
+			exchangeCurrentCompletion(outer);
+			std::shared_ptr<TaskCompletion> completion(std::move(completion_));
+			completion->complete();
+		}
+
+	private:
+		// 先析构packaged_task，future得到broken_promise之后再通知，whenAll拿到的future都已经就绪
+		void drop()
+		{
+			{
+				std::packaged_task<R()> dropped(std::move(task_));
+			}
+			std::shared_ptr<TaskCompletion> completion(std::move(completion_));
+			completion->complete();
+		}
+
+		std::packaged_task<R()> task_;
+		std::shared_ptr<TaskCompletion> completion_;
+	};
+
+	template<typename R>
+	static Task completionTask(std::packaged_task<R()> task, std::shared_ptr<TaskCompletion> completion)
+	{
+		return CompletionTask<R>(std::move(task), std::move(completion));
+	}
+
+	// 设置当前线程正在执行的任务，返回原来的值
+	static TaskCompletion* exchangeCurrentCompletion(TaskCompletion* completion);
+
+	// 设置当前线程的编号
+	static void setCurrentWorkerIndex(int index);
+
+	// 当前线程所属的线程池，不是线程池的线程时为nullptr
+	static ThreadPoolBase* currentPool();
+	static void setCurrentPool(ThreadPoolBase* pool);
+
+	// 共享线程调用		是否有任务并且没有达到占用共享线程的上限，不加锁，只是提示
+	virtual bool hasSharedTask() const = 0;
+
+	// 共享线程调用		取一个任务并执行，占用一个共享线程的名额，执行完归还，取不到时返回false
+	virtual bool runSharedTask() = 0;
+
+	// 看门狗检查队列进展用：所有租户累计执行完的任务数量，排队的任务数量(包括线程缓冲里的任务)
+	virtual uint64_t completedTaskSize() const = 0;
+	virtual int pendingTaskSize() const = 0;
+
+	// Strand、限流执行器、Reactor调用		放入已经拿到执行权的任务，不检查任务队列上限
+	virtual void scheduleTask(Task task, const TaskOption& option) = 0;
+
+	// tryPostFor调用		任务队列满或者线程池没有启动时最多等待timeout，失败时task保持不变
+	virtual bool scheduleTaskFor(Task& task, std::chrono::milliseconds timeout) = 0;
+
+	// 到time时在定时线程上调用func，第一次调用时启动定时线程		func应该很短，不能阻塞
+	// 线程池析构时还没有到时间的func不再调用，直接析构
+	virtual void postAfter(std::chrono::steady_clock::time_point time, Task func) = 0;
+
+	// 进入和离开阻塞区
+	virtual void enterBlocking() = 0;
+	virtual void leaveBlocking() = 0;
 };
 
 /*
@@ -48,128 +428,968 @@ example:
 ThreadPool pool;
 pool.start();
 
-class MyTask: public Task
-{
-public:
-	void run(){ // ̴߳... }
-};
+// 不关心结果的任务
+pool.post([]() { ... });
 
-pool.submitTask(std::make_shared<MyTask>());
+// 需要结果的任务，返回TaskFuture
+auto result = pool.submitTask([](int a, int b) { return a + b; }, 1, 2);
+int sum = result.get();
 */
-// ̳߳
-class ThreadPool
+// 线程池类型		策略见poolpolicy.h，ThreadPool是默认策略的BasicThreadPool
+// Strand、限流执行器、Reactor和ShmServer通过ThreadPoolBase使用线程池，parallel.h的算法是模板，任何策略的线程池都可以使用
+template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+class BasicThreadPool : public ThreadPoolBase
 {
 public:
-	ThreadPool();
-	~ThreadPool();
+	BasicThreadPool();
+	~BasicThreadPool();
 
-	// ֹû̳߳ؽп
-	ThreadPool(const ThreadPool&) = delete;
-	ThreadPool& operator=(const ThreadPool&) = delete;
+	// 禁止用户对线程池进行拷贝操作
+	BasicThreadPool(const BasicThreadPool&) = delete;
+	BasicThreadPool& operator=(const BasicThreadPool&) = delete;
 
 
-	// ̳߳
-	void start(int initThreadSize = std::thread::hardware_concurrency()); // CPUĺ
+	// 启动线程池
+	void start(int initThreadSize = std::thread::hardware_concurrency()); // 返回CPU的核心数量
 
-	// ̳߳ģʽ
+	// 设置线程池模式		运行中也可以切换，cached切换到fixed后多出来的线程空闲时退出
+	// 只对SizingPolicy为RuntimeSize的线程池有效，其它线程池的模式在编译期确定
 	void setMode(ThreadPoolMode mode);
 
-	//// óʼ߳
-	//void setinitThreadSize(int size);
+	// 修改初始的线程数量(fixed模式的线程数量，cached模式最少保留的线程数量)，start之后调用才有效
+	// 增加时立即创建线程，减少时多出来的线程执行完手里的任务后退出，排队的任务不受影响
+	void resize(int threadSize);
 
-	// taskֵ
+	// 设置task队列上限阈值		运行中也可以修改，调小时已经排队的任务不受影响
 	void setTaskQueMaxThreshHold(int threshhold);
 
-	// ̳߳cachedģʽֵ߳
+	// 设置线程的栈大小，默认使用系统的默认值(通常是8MB虚拟内存)
+	// 线程数量多、任务调用栈不深时可以调小，减少内存映射
+	void setThreadStackSize(size_t stackSize);
+
+	// 设置线程名称的前缀，线程名称为"前缀-线程编号"，Linux下最长15个字符
+	void setThreadName(const std::string& name);
+
+	// 设置延迟启动：start不创建线程，有任务并且空闲线程不够时再逐个创建，最多initThreadSize个
+	// 默认start创建所有初始线程，等它们都初始化完成后返回
+	// 初始线程按树形创建：start只创建第0个线程，每个线程再创建两个，创建的耗时也并行分摊
+	void setLazyStart(bool isLazy);
+
+	// 设置排队任务的开销之和的上限，默认不限制
+	// 开销由提交时的TaskOption::cost_指定，单位由调用者决定，比如字节数
+	// 超过上限时和任务数量超过上限一样，提交最多等待1s；队列为空时开销超过上限的单个任务也可以提交
+	// 运行中也可以修改，调小时已经排队的任务不受影响
+	void setTaskQueMaxCost(size_t maxCost);
+
+	// 获取统计数据
+	ThreadPoolStats getStats() const;
+
+	// 设置租户的权重，默认为1，可以在运行时修改
+	// 不同租户的任务放在各自的队列里，按权重轮流执行(deficit round robin)：
+	// 每一轮权重为2的租户最多执行2个任务，权重为1的租户最多执行1个，一个租户提交再多任务也不会饿死其它租户
+	void setTenantWeight(int tenant, int weight);
+
+	// 设置租户同时执行的任务数量上限，0表示不限制(默认)，可以在运行时修改
+	// 带亲和性key的任务不受这个上限限制
+	void setTenantMaxConcurrency(int tenant, int maxConcurrency);
+
+	// 获取所有租户的统计数据，按租户ID排序
+	std::vector<TenantStats> getTenantStats() const;
+
+	// 设置线程池cached模式下线程阈值		运行中也可以修改，调小时多出来的线程空闲时退出
+	// fixed模式下设置的值在切换到cached模式后生效
 	void setThreadSizeMaxThreshHold(int threadthreshhold);
 
-	// ̳߳ύ
-	// ʹÿɱģ̣submitTaskԽĲ
-	// ֵfuture<>
-	// עģ̵ĺʵֲܷ.cppļ£ӲϡҪʾʵ
+	// 设置亲和性任务的窃取延迟
+	// 亲和性任务在所属线程的队列里等待超过这个时间，空闲的其它线程才可以把它取走
+	// 运行中也可以修改，对已经排队的任务同样生效
+	void setAffinityStealDelay(std::chrono::milliseconds delay);
+
+	// 设置线程每次从任务队列最多取的任务数量，1表示每次取一个
+	// 默认为1，不批量取，任务多、执行时间短时可以调大，分摊加锁和通知的开销
+	// 运行中也可以修改，线程下一次从任务队列取任务时生效
+	// 实际数量按排队的任务数量和空闲线程数量调整，多取的任务放在线程自己的缓冲里
+	// 缓冲里的任务开始执行之前仍然计入taskSize_和queuedCost_，任务队列的数量上限和开销上限照常生效
+	// 空闲的其它线程会从缓冲里窃取，一个任务执行时间很长时，缓冲里的任务不会一直等待
+	void setTaskBatchSize(int batchSize);
+
+	// 设置线程池在共享线程上的权重，默认为1
+	// 共享线程忙时，每一轮调度中权重为2的线程池执行的任务数量是权重为1的两倍
+	void setWeight(int weight);
+
+	// 设置线程启动和退出时调用的函数，参数是线程的编号
+	// init在线程执行第一个任务之前调用，exit在线程退出之前调用，都在线程自己上执行，不持有线程池的锁
+	// cached模式新建和回收线程时同样调用，共享线程模式下不调用
+	void setWorkerInit(std::function<void(int)> func);
+	void setWorkerExit(std::function<void(int)> func);
+
+	// 给线程池提交任务
+	// 使用可变参模板编程，让submitTask可以接收任意任务函数和任意数量的参数
+	// 函数和参数按值保存，右值只移动不拷贝，支持只能移动的函数对象和参数
+	// 返回值TaskFuture<>，可以当作future<>使用
+	// 注意模板编程的函数实现不能放在.cpp文件下，否则链接不上。需要显示实例化
 	template<typename Func, typename... Args>
-	auto submitTask(Func&& func, Args&&... args) -> std::future<decltype(func(args...))>
+	auto submitTask(Func&& func, Args&&... args) -> TaskFuture<TaskResult<Func, Args...>>
 	{
-		// 񣬷
-		using RType = decltype(func(args...));
-		auto task = std::make_shared<std::packaged_task<RType()>>(
-			std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
-		std::future<RType> result = task->get_future();
+		return submitTask(TaskOption(), std::forward<Func>(func), std::forward<Args>(args)...);
+	}
 
-		// ȡ
+	// 提交带亲和性key的任务
+	// 相同key的任务通过一致性哈希优先交给同一个线程执行，提高cache命中率
+	template<typename Func, typename... Args>
+	auto submitTask(size_t affinityKey, Func&& func, Args&&... args) -> TaskFuture<TaskResult<Func, Args...>>
+	{
+		TaskOption option;
+		option.hasAffinity_ = true;
+		option.affinityKey_ = affinityKey;
+		return submitTask(option, std::forward<Func>(func), std::forward<Args>(args)...);
+	}
+
+	// 提交带选项的任务
+	template<typename Func, typename... Args>
+	auto submitTask(const TaskOption& option, Func&& func, Args&&... args) -> TaskFuture<TaskResult<Func, Args...>>
+	{
+		// 打包任务，放入任务队列里面
+		using RType = TaskResult<Func, Args...>;
+		std::packaged_task<RType()> task(bindTask(std::forward<Func>(func), std::forward<Args>(args)...));
+		auto completion = std::make_shared<TaskCompletion>();
+		TaskFuture<RType> result(task.get_future(), completion);
+
+		// 获取锁
 		std::unique_lock<std::mutex> lock(taskQueMtx_);
 
-		// ûύ1sжύʧܣ
-		if (!notFull_.wait_for(lock, std::chrono::seconds(1),
-			[&]()->bool { return taskQue_.size() < (size_t)taskQueMaxThreshHold_; }))
+		if (!waitNotFull(lock, option))
 		{
-			// ʾnotFull_ȴ1sȻû
-			std::cerr << "task queue is full, submit task fail." << std::endl;
-			auto task = std::make_shared<std::packaged_task<RType()>>(
-				[]()->RType { return RType(); });
-			(*task)();
-			return task->get_future();
+			std::packaged_task<RType()> task([]()->RType { return RType(); });
+			task();
+			completion->complete();
+			return TaskFuture<RType>(task.get_future(), completion);
 		}
 
-		// п࣬
-		//taskQue_.emplace(sp);
-		//using Task = std::function<void(int)>;
-		taskQue_.emplace([task]() { (*task)(); });
-		taskSize_++;
+		// 如果有空余，把任务放入任务队列中		packaged_task只能移动，直接放进Task
+		pushTask(completionTask(std::move(task), std::move(completion)), option);
 
-		// Ϊ·п϶գnotEmpty_Ͻ֪ͨϿִ߳
-		notEmpty_.notify_all();
+		// 返回任务的Result对象
+		return result;
+	}
 
-		// cachedģʽ ȽϽ С ҪͿ߳жǷҪµ̳߳
-		if (poolMode_ == ThreadPoolMode::MODE_CACHED && taskSize_ > idleThreadSize_ && curThreadSize_ < threadSizeThreshHold_)
+	// 提交不需要返回值的任务
+	// 不创建future和packaged_task，没有共享状态，适合大量只管提交的任务
+	// 任务队列满时和submitTask一样最多等待1s，提交失败任务被丢弃
+	// 任务抛出的异常由执行它的线程捕获，输出到std::cerr并计入ThreadPoolStats::failedTaskSize_，线程池继续运行
+	// 需要拿到异常时使用submitTask，异常保存在future里
+	template<typename Func, typename... Args>
+	auto post(Func&& func, Args&&... args) -> std::enable_if_t<std::is_invocable<std::decay_t<Func>, std::decay_t<Args>...>::value>
+	{
+		post(TaskOption(), std::forward<Func>(func), std::forward<Args>(args)...);
+	}
+
+	// 提交带选项的不需要返回值的任务
+	template<typename Func, typename... Args>
+	void post(const TaskOption& option, Func&& func, Args&&... args)
+	{
+		Task task(bindTask(std::forward<Func>(func), std::forward<Args>(args)...));
+
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		if (!waitNotFull(lock, option))
 		{
-			std::cout << ">>> create new thread!!!" << std::endl;
-			// µ̶߳
-			auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1)); // placeholders ռλ
-			//threads_.emplace_back(std::move(ptr));
-			int threadId = ptr->getThreadId();
-			threads_.emplace(threadId, std::move(ptr));
+			return;
+		}
+		pushTask(std::move(task), option);
+	}
+
+	// 尝试提交不需要返回值的任务，线程池没有启动或者任务队列已满时不等待，直接返回false
+	// 适合调用者自己也能完成工作的场景，比如parallelFor的辅助任务
+	template<typename Func, typename... Args>
+	bool tryPost(Func&& func, Args&&... args)
+	{
+		Task task(bindTask(std::forward<Func>(func), std::forward<Args>(args)...));
 
-			// ߳
-			threads_[threadId]->start();
-			// ޸̸߳صı
-			curThreadSize_++;
-			idleThreadSize_++;
+		std::lock_guard<std::mutex> lock(taskQueMtx_);
+		if (!isPoolRunning_ || isFull(TaskOption()))
+		{
+			return false;
 		}
+		pushTask(std::move(task));
+		return true;
+	}
 
-		// Result
-		//return task->getResult(); // Task Result 
-		return result;
+	// 开始记录每个任务的时间线，清空之前的记录
+	void startProfiling();
+
+	// 停止记录
+	void stopProfiling();
+
+	// 导出记录的时间线，Chrome Trace Event格式的JSON，可以用Perfetto或者chrome://tracing打开
+	void exportTrace(std::ostream& out) const;
+
+	/*
+	example:
+	pool.startWatchdog(std::chrono::seconds(5), [](int workerId, const char* label, std::chrono::milliseconds elapsed) {
+		LOG_WARN("worker %d task %s running %lld ms", workerId, label ? label : "-", (long long)elapsed.count());
+	});
+	*/
+	// 启动看门狗：之后提交的任务执行时间超过threshold，或者有排队的任务但是threshold时间内没有任务执行完时调用callback
+	// callback在看门狗线程上调用，参数是线程编号(队列没有进展时为-1)、任务名称(TaskOption::label_)和已经经过的时间
+	void startWatchdog(std::chrono::milliseconds threshold, WatchdogCallback callback);
+
+	// 停止看门狗
+	void stopWatchdog();
+
+	// 提交会阻塞的任务，阻塞区见ThreadPoolBase::blockingSection，整个任务都在阻塞区里执行
+	template<typename Func, typename... Args>
+	auto submitBlocking(Func&& func, Args&&... args) -> TaskFuture<TaskResult<Func, Args...>>
+	{
+		return submitTask([this](auto&& task) {
+			auto guard = blockingSection();
+			return task();
+		}, bindTask(std::forward<Func>(func), std::forward<Args>(args)...));
 	}
 
+#ifdef __linux__
+	// 启动线程池的异步IO线程Reactor，优先使用io_uring，useIoUring为false或者内核不支持时使用epoll
+	// 不调用时，第一次asyncRead/asyncWrite自动启动
+	void startReactor(bool useIoUring = true);
+
+	// 异步读写，off小于0表示使用文件当前位置
+	// 等待IO时不占用线程池的线程，完成后由线程池的线程设置结果：读写的字节数，失败时为-errno
+	// buf在future就绪之前必须保持有效
+	// 同一个fd上同时有多个请求时，io_uring不保证它们的完成顺序
+	// 返回的TaskFuture可以交给whenAll/whenAny，已经提交的IO不能取消，cancel()不起作用
+	TaskFuture<ssize_t> asyncRead(int fd, void* buf, size_t len, off_t off = -1);
+	TaskFuture<ssize_t> asyncWrite(int fd, const void* buf, size_t len, off_t off = -1);
+#endif
+
+	// 创建一个串行执行器Strand
+	// 投递到同一个Strand的任务严格按提交顺序执行，且不会并发执行
+	// Strand没有自己的线程，任务仍然由线程池的线程执行，同一时刻最多占用一个线程
+	std::shared_ptr<Strand> makeStrand();
+
+	// 创建一个限制并发的执行器，通过它提交的任务同一时刻最多占用maxConcurrent个线程
+	// 没有执行名额的任务在执行器自己的队列里等待，不占用线程池的线程和任务队列
+	std::shared_ptr<ThrottledExecutor> limited(int maxConcurrent);
+
+	// 创建一个限制速率的执行器，通过它提交的任务平均每秒最多开始执行tasksPerSec个，最多连续开始burst个
+	// 没有令牌的任务在执行器自己的队列里等待，到时间由线程池的定时线程放入任务队列
+	// 线程池析构时还在等待令牌的任务不再执行，future得到broken_promise，whenAll/whenAny照常就绪
+	std::shared_ptr<ThrottledExecutor> rateLimited(double tasksPerSec, int burst = 1);
+
 private:
-	// ̺߳		bind󶨳ɺ
-	void threadFunc(int threadid);
+	struct Tenant;
+
+	// 排队的任务
+	struct QueuedTask
+	{
+		Task task_;
+		size_t cost_; // 任务的开销
+		std::chrono::high_resolution_clock::time_point enqueueTime_; // 入队时间
+		Tenant* tenant_; // 所属的租户
+	};
+
+	// 租户		创建后不会删除，地址不变
+	struct Tenant
+	{
+		int id_;
+		int weight_ = 1; // 每一轮的配额
+		std::atomic_int maxRunningSize_{ 0 }; // 同时执行的任务数量上限，0表示不限制
+		int deficit_ = 0; // 这一轮剩余的配额
+		bool isActive_ = false; // 是否在activeTenants_里
+		typename QueuePolicy::template Queue<QueuedTask> taskQue_; // 租户的任务队列，不包括线程入队列里的任务
+		std::deque<QueuedTask> overflowQue_; // 有界队列满时内部提交的任务(不等待队列不满)，按顺序排在taskQue_后面
+		int queuedSize_ = 0; // 排队的任务数量，包括线程入队列里的任务
+		std::atomic_int runningSize_{ 0 }; // 正在执行的任务数量
+		uint64_t submittedSize_ = 0;
+		std::atomic<uint64_t> completedSize_{ 0 };
+	};
+
+	// 每个初始线程的入队列，存放亲和到这个线程的任务
+	struct WorkerSlot
+	{
+		std::queue<QueuedTask> taskQue_;
+		bool hasThread_ = false; // 是否有线程在使用这个入队列
+	};
+
+	// 线程批量取出的任务		已经从任务队列里取出并计入了租户的runningSize_
+	struct BatchedTask
+	{
+		Task task_;
+		Tenant* tenant_;
+		size_t cost_; // 开始执行之前仍然计入queuedCost_
+	};
+
+	// 等待任务的线程		在自己的条件变量上等待，提交的任务可以不经过任务队列直接交给它
+	struct WorkerPark
+	{
+		std::condition_variable cond_;
+		IdlePolicy idle_; // 等待方式
+		std::atomic_bool isNotified_{ false }; // 是否被唤醒，自旋等待时不加锁读取
+		Task task_; // 直接交给这个线程的任务
+		Tenant* tenant_ = nullptr;
+		bool hasTask_ = false;
+
+		WorkerPark()
+		{
+			// 自旋的等待策略需要唤醒提示
+			if constexpr (hasIdleHint(0))
+			{
+				idle_.hint_ = &isNotified_;
+			}
+		}
+	};
+
+	// 等待策略是否需要唤醒提示
+	template<typename P = IdlePolicy>
+	static constexpr auto hasIdleHint(int) -> decltype(std::declval<P&>().hint_, bool())
+	{
+		return true;
+	}
+	static constexpr bool hasIdleHint(...)
+	{
+		return false;
+	}
+
+	// 线程自己的任务缓冲		线程从队头取，其它空闲线程从队尾窃取
+	struct TaskBatch
+	{
+		std::mutex mtx_; // 保护taskQue_，和taskQueMtx_一起持有时先获取taskQueMtx_
+		std::deque<BatchedTask> taskQue_;
+	};
+
+	// 用户提交任务，最长不能阻塞超过1s，否则判断提交任务失败，返回false
+	// 任务数量和开销之和都不能超过上限，调用者必须已经持有taskQueMtx_
+	bool waitNotFull(std::unique_lock<std::mutex>& lock, const TaskOption& option);
+
+	// 再放入一个任务是否会超过上限，有界的QueuePolicy还要检查租户的队列是否已满
+	// 调用者必须已经持有taskQueMtx_
+	bool isFull(const TaskOption& option) const;
 
-	// ̳߳״̬
+	// 是否是cached模式		SizingPolicy在编译期确定时是常量
+	bool isCachedMode() const
+	{
+		if constexpr (SizingPolicy::IS_RUNTIME)
+		{
+			return poolMode_ == ThreadPoolMode::MODE_CACHED;
+		}
+		else
+		{
+			return SizingPolicy::IS_CACHED;
+		}
+	}
+
+	// 把任务放入任务队列，通知线程执行，cached模式下按需创建新线程
+	// 有亲和性key时放入对应线程的入队列，否则放入公共队列
+	// 调用者必须已经持有taskQueMtx_，不检查任务队列上限，有界的QueuePolicy要先用isFull检查
+	void pushTask(Task task, const TaskOption& option = TaskOption());
+
+	// 创建并启动一个线程，slot是线程入队列的下标，没有入队列时为-1
+	// 调用者必须已经持有taskQueMtx_
+	void addThread(int slot = -1);
+
+	// 是否需要为阻塞的线程创建补偿线程
+	bool needCompensation() const;
+
+	// 当前线程是不是多余的：阻塞区结束后的补偿线程，cached模式超过上限的线程，resize减少后编号超出范围的初始线程
+	bool isSurplusThread(int slot) const;
+
+	// 进入和离开阻塞区
+	void enterBlocking() override;
+	void leaveBlocking() override;
+
+	// 一致性哈希，把亲和性key映射到线程的入队列，线程池还没有启动时返回-1
+	int affinitySlot(size_t affinityKey) const;
+
+	// 取一个当前线程可以执行的任务：先取自己的入队列，再取公共队列，最后窃取其它线程等待超时的任务
+	// 取不到任务时返回false，nextSteal返回最早可以窃取的时间点
+	// 公共队列按租户的权重轮流取，跳过达到并发上限的租户
+	// 取到任务时从queuedCost_里减去它的开销，tenant返回任务所属的租户，任务执行完要调用finishTask
+	// 调用者必须已经持有taskQueMtx_
+	bool popTask(int slot, Task& task, Tenant*& tenant, std::chrono::high_resolution_clock::time_point& nextSteal);
+
+	// 从队列里取出任务后的记录		调用者必须已经持有taskQueMtx_
+	void takeTask(QueuedTask& queued, Task& task, Tenant*& tenant);
+
+	// 从租户的队列里按deficit round robin取一个任务		调用者必须已经持有taskQueMtx_
+	bool popTenantTask(Task& task, Tenant*& tenant);
+
+	// 查找租户，不存在时创建		调用者必须已经持有taskQueMtx_
+	Tenant* findTenant(int tenant);
+
+	// 任务执行完，不持有taskQueMtx_时调用
+	void finishTask(Tenant* tenant);
+
+	// 执行任务		任务抛出的异常在这里捕获并报告，线程继续执行下一个任务
+	void runTask(Task& task);
+
+	// 定义线程函数		用bind绑定器绑定成函数对象
+	// slot是线程入队列的下标，cached模式下额外创建的线程没有入队列，为-1
+	void threadFunc(int threadid, int slot);
+
+	// 检查线程池启动状态
 	bool checkRunningState() const;
 
+	// 共享线程调用		是否有任务并且没有达到占用共享线程的上限，不加锁，只是提示
+	bool hasSharedTask() const override;
+
+	// 共享线程调用		取一个任务并执行
+	bool runSharedTask() override;
+
+	// 共享线程调用		取一个任务，占用一个共享线程的名额，取不到时返回false
+	bool popSharedTask(Task& task, Tenant*& tenant);
+
+	// 共享线程调用		任务执行完，归还名额
+	void finishSharedTask(Tenant* tenant);
+
+	// 把任务直接交给一个等待的线程，没有等待的线程或者不能直接交出时返回false
+	// 调用者已经持有taskQueMtx_
+	bool handOff(Task& task, Tenant* tenant, int slot);
+
+	// 当前线程等待到deadline，期间可能被直接交给任务，返回false表示超时
+	// 调用者已经持有taskQueMtx_
+	bool parkWorker(WorkerPark& park, std::unique_lock<std::mutex>& lock, std::chrono::high_resolution_clock::time_point deadline);
+
+	// 唤醒所有等待的线程		调用者已经持有taskQueMtx_
+	void notifyWorkers();
+
+	// 这次从任务队列里取的任务数量		调用者已经持有taskQueMtx_，并且已经取出了一个任务
+	int batchSize() const;
+
+	// 从自己的缓冲里取一个任务，不需要持有taskQueMtx_
+	bool popBatchTask(TaskBatch* batch, Task& task, Tenant*& tenant);
+
+	// 缓冲里的任务开始执行，从taskSize_和queuedCost_里减去		调用者已经持有batch的mtx_
+	void takeBatchedTask(BatchedTask& batched, Task& task, Tenant*& tenant);
+
+	// 从其它线程的缓冲里窃取一个任务		调用者已经持有taskQueMtx_
+	bool stealBatchTask(Task& task, Tenant*& tenant);
+
+	// 看门狗检查队列进展用：所有租户累计执行完的任务数量，排队的任务数量(包括线程缓冲里的任务)
+	uint64_t completedTaskSize() const override;
+	int pendingTaskSize() const override;
+
+	// 获取锁后放入任务		Strand、限流执行器、Reactor用
+	void scheduleTask(Task task, const TaskOption& option) override;
+
+	// 等待任务队列不满后放入任务		tryPostFor用
+	bool scheduleTaskFor(Task& task, std::chrono::milliseconds timeout) override;
+
+	// 到time时在定时线程上调用func		不能持有taskQueMtx_调用
+	void postAfter(std::chrono::steady_clock::time_point time, Task func) override;
+
+	// 停止定时线程，还没有到时间的func不再调用
+	void stopTimer();
+
+	// 定时线程函数
+	void timerFunc();
+
+	// 分配和归还线程编号，调用者必须已经持有taskQueMtx_
+	int acquireWorkerIndex();
+	void releaseWorkerIndex(int index);
+
+	// 线程退出：调用exit函数，归还编号，从threads_里删除
+	// 调用者必须已经持有taskQueMtx_，线程数量相关的变量已经修改
+	void exitThread(int threadid, std::unique_lock<std::mutex>& lock);
+
 private:
 	std::unordered_map<int, std::unique_ptr<Thread>> threads_;
-	int initThreadSize_; // ʼ߳
-	// cachedģʽ
-	std::atomic_int curThreadSize_; // ¼ǰ̳߳߳
-	int threadSizeThreshHold_; // ߳޵ֵ
-	std::atomic_int idleThreadSize_; // ¼̵߳
-
-	// Task =
-	using Task = std::function<void()>;
-	std::queue<Task> taskQue_;// ָ ʵֶ̬ Ҫ֤ ʹָ
-	std::atomic_int taskSize_; //  ǵ̰߳ȫ ԭ
-	int taskQueMaxThreshHold_; // ޵ֵ
-
-	std::mutex taskQueMtx_; // ֤е̰߳ȫ
-	std::condition_variable notFull_; // ʾв
-	std::condition_variable notEmpty_; // ʾв
-	std::condition_variable exitCond_; // ȴ߳Դȫ
-
-	ThreadPoolMode poolMode_; // ̳߳ģʽ
-	std::atomic_bool isPoolRunning_; // ʾǰ̳߳ص״̬
+	std::atomic_int initThreadSize_; // 初始的线程数量		共享线程不加锁读取，resize可以修改
+	// cached模式
+	std::atomic_int curThreadSize_; // 记录当前线程池里面线程数量
+	std::atomic_int threadSizeThreshHold_; // 线程数量上限的阈值
+	std::atomic_int idleThreadSize_; // 记录空闲线程的数量
+
+	std::unordered_map<int, std::unique_ptr<Tenant>> tenants_; // 所有租户，每个租户一个任务队列，代替原来的公共队列taskQue_
+	std::deque<Tenant*> activeTenants_; // 有排队任务的租户，轮流执行的顺序
+	std::atomic_int taskSize_; // 任务数量(包括线程入队列里的任务) 考虑到线程安全 用原子类型
+	int taskQueMaxThreshHold_; // 任务队列数量上限的阈值
+	std::atomic<size_t> queuedCost_; // 排队任务(包括线程入队列里的任务)的开销之和
+	std::atomic<size_t> peakQueuedCost_; // queuedCost_的最大值
+	size_t taskQueMaxCost_; // 开销之和的上限
+	std::atomic<uint64_t> failedTaskSize_; // 抛出异常的任务数量
+
+	std::vector<std::unique_ptr<WorkerSlot>> workerSlots_; // 初始线程的入队列
+	std::chrono::milliseconds affinityStealDelay_; // 亲和性任务的窃取延迟
+
+	std::atomic_int blockedThreadSize_; // 阻塞区里的线程数量
+
+	int taskBatchSize_; // 每次最多取的任务数量
+	std::vector<std::unique_ptr<TaskBatch>> taskBatches_; // 线程的任务缓冲，按线程编号索引，只增加不删除
+	std::atomic_int batchedTaskSize_; // 所有缓冲里的任务数量，这些任务也计入taskSize_
+
+	// 共享线程
+	bool isShared_; // start时是否交给了Scheduler
+	int weight_; // 在共享线程上的权重
+	std::atomic_int runningSharedSize_; // 正在执行这个线程池任务的共享线程数量
+
+	std::function<void(int)> workerInit_; // 线程启动时调用
+	std::function<void(int)> workerExit_; // 线程退出时调用
+	std::vector<bool> workerIndexUsed_; // 已经分配的线程编号
+
+	// 线程创建
+	size_t threadStackSize_; // 线程栈大小，0表示默认值
+	std::string threadName_; // 线程名称前缀，为空时不设置
+	bool isLazyStart_; // 是否延迟创建初始线程
+	int spawnedSlotSize_; // 已经创建的初始线程数量
+	int spawnTreeSize_; // start时按树形创建的初始线程数量，start返回后为0
+	int readyThreadSize_; // 完成初始化的线程数量
+	std::condition_variable readyCond_; // 等待初始线程完成初始化
+
+	Profiler profiler_; // 任务时间线记录
+	Watchdog watchdog_; // 看门狗，析构函数里在线程全部退出后停止
+
+#ifdef __linux__
+	std::unique_ptr<Reactor> reactor_; // 异步IO线程，没有启动时为nullptr
+	std::mutex reactorMtx_; // 保证reactor_只启动一次
+#endif
+
+	// 定时线程		rateLimited执行器等待令牌用，第一次postAfter时启动
+	std::thread timerThread_;
+	std::multimap<std::chrono::steady_clock::time_point, Task> timers_; // 按时间排序的定时任务
+	bool isTimerStopped_; // 析构时停止，之后的postAfter直接丢弃
+	std::mutex timerMtx_; // 保护上面的成员
+	std::condition_variable timerCond_; // 有更早的定时任务或者停止
+
+	mutable std::mutex taskQueMtx_; // 保证任务队列的线程安全
+	std::condition_variable notFull_; // 表示任务队列不满
+	std::atomic_int notFullWaiters_; // 在notFull_上等待的提交者数量，缓冲里的任务开始执行时不持有锁，有人等待才通知
+	std::vector<WorkerPark*> parkedWorkers_; // 等待任务的线程，后等待的先交出任务(缓存还是热的)
+	std::condition_variable exitCond_; // 等待线程资源全部回收
+
+	std::atomic<ThreadPoolMode> poolMode_; // 线程池模式
+	std::atomic_bool isPoolRunning_; // 表示当前线程池的启动状态
 
 };
+
+// 默认策略的线程池在threadpool.cpp里显式实例化，其它翻译单元不再实例化
+extern template class BasicThreadPool<>;
+
+/*
+example:
+WorkerLocal<std::vector<char>> buffers([]() { return std::vector<char>(4096); });
+pool.submitTask([&]() { auto& buf = buffers.local(); ... });
+*/
+// 线程局部存储类型		每个线程一个T，第一次使用时构造
+// 每个实例单独占用cache line，线程之间不会伪共享
+// 按ThreadPoolBase::currentWorkerIndex()区分线程，一个WorkerLocal只能在一个线程池的任务里使用
+template<typename T>
+class WorkerLocal
+{
+public:
+	WorkerLocal() : WorkerLocal([]() { return T(); })
+	{
+	}
+
+	// factory用来构造每个线程的实例
+	explicit WorkerLocal(std::function<T()> factory) : factory_(std::move(factory))
+	{
+		for (auto& segment : segments_)
+		{
+			segment = nullptr;
+		}
+	}
+
+	~WorkerLocal()
+	{
+		for (auto& segment : segments_)
+		{
+			delete[] segment.load();
+		}
+	}
+
+	WorkerLocal(const WorkerLocal&) = delete;
+	WorkerLocal& operator=(const WorkerLocal&) = delete;
+
+	// 当前线程的实例，只能在线程池的线程上调用
+	T& local()
+	{
+		int index = ThreadPoolBase::currentWorkerIndex();
+		if (index < 0 || index >= SEGMENT_SIZE * SEGMENT_COUNT)
+		{
+			throw std::out_of_range("WorkerLocal::local() must be called on a worker thread");
+		}
+
+		// 分段按需分配，多个线程同时分配时只保留一个
+		auto& segmentPtr = segments_[index / SEGMENT_SIZE];
+		Slot* segment = segmentPtr.load(std::memory_order_acquire);
+		if (segment == nullptr)
+		{
+			Slot* fresh = new Slot[SEGMENT_SIZE];
+			if (segmentPtr.compare_exchange_strong(segment, fresh, std::memory_order_acq_rel))
+			{
+				segment = fresh;
+			}
+			else
+			{
+				delete[] fresh;
+			}
+		}
+
+		// 一个编号同一时刻只属于一个线程，构造不需要加锁
+		Slot& slot = segment[index % SEGMENT_SIZE];
+		if (!slot.value_)
+		{
+			slot.value_.emplace(factory_());
+		}
+		return *slot.value_;
+	}
+
+	// 合并所有线程的实例：init = func(init, value)
+	// 必须在使用它的任务都执行完之后调用，比如所有future都get之后
+	template<typename R, typename Func>
+	R combine(R init, Func func) const
+	{
+		for (auto& segmentPtr : segments_)
+		{
+			Slot* segment = segmentPtr.load(std::memory_order_acquire);
+			for (int i = 0; segment != nullptr && i < SEGMENT_SIZE; i++)
+			{
+				if (segment[i].value_)
+				{
+					init = func(std::move(init), *segment[i].value_);
+				}
+			}
+		}
+		return init;
+	}
+
+	// 遍历所有线程的实例，调用时机和combine一样
+	template<typename Func>
+	void forEach(Func func)
+	{
+		for (auto& segmentPtr : segments_)
+		{
+			Slot* segment = segmentPtr.load(std::memory_order_acquire);
+			for (int i = 0; segment != nullptr && i < SEGMENT_SIZE; i++)
+			{
+				if (segment[i].value_)
+				{
+					func(*segment[i].value_);
+				}
+			}
+		}
+	}
+
+private:
+	static const int SEGMENT_SIZE = 64; // 每段的线程数量
+	static const int SEGMENT_COUNT = 64; // 最多64段，支持4096个线程
+
+	// 独占cache line的实例
+	struct alignas(64) Slot
+	{
+		std::optional<T> value_;
+	};
+
+	std::function<T()> factory_;
+	std::atomic<Slot*> segments_[SEGMENT_COUNT];
+};
+
+/*
+example:
+auto strand = pool.makeStrand();
+strand->submitTask(func1); // func1执行完之后才会执行func2
+strand->submitTask(func2);
+*/
+// 串行执行器类型
+class Strand : public std::enable_shared_from_this<Strand>
+{
+public:
+	~Strand() = default;
+
+	Strand(const Strand&) = delete;
+	Strand& operator=(const Strand&) = delete;
+
+	// 给Strand提交任务，用法和ThreadPool::submitTask一样
+	template<typename Func, typename... Args>
+	auto submitTask(Func&& func, Args&&... args) -> TaskFuture<TaskResult<Func, Args...>>
+	{
+		using RType = TaskResult<Func, Args...>;
+		std::packaged_task<RType()> task(bindTask(std::forward<Func>(func), std::forward<Args>(args)...));
+		auto completion = std::make_shared<TaskCompletion>();
+		TaskFuture<RType> result(task.get_future(), completion);
+
+		postTask(ThreadPoolBase::completionTask(std::move(task), std::move(completion)));
+		return result;
+	}
+
+	// 给Strand提交不需要返回值的任务，用法和ThreadPool::post一样
+	template<typename Func, typename... Args>
+	void post(Func&& func, Args&&... args)
+	{
+		postTask(bindTask(std::forward<Func>(func), std::forward<Args>(args)...));
+	}
+
+private:
+	template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+	friend class BasicThreadPool;
+
+	Strand(ThreadPoolBase& pool);
+
+	// 任务放入Strand自己的队列，如果Strand还没有被调度，就给线程池投递一个drain任务
+	void postTask(Task task);
+
+	// 给线程池投递一个drain任务
+	void schedule();
+
+	// 在线程池的线程上按顺序执行Strand队列里的任务，执行任务时不持有任何锁
+	// 任务抛出异常时重新调度剩下的任务，异常交给线程池报告
+	void drain();
+
+private:
+	ThreadPoolBase& pool_; // 所属的线程池
+	std::queue<Task> taskQue_; // Strand自己的任务队列
+	std::mutex taskQueMtx_; // 只保护taskQue_和isScheduled_
+	bool isScheduled_; // 线程池的队列里或者线程上是否已经有这个Strand的drain任务
+};
+
+/*
+example:
+auto limited = pool.limited(2);
+for (...) limited->submitTask(func); // 同一时刻最多2个func在执行
+auto throttled = pool.rateLimited(100, 10);
+for (...) throttled->post(func); // 平均每秒最多开始100个func
+*/
+// 限流执行器类型		ThreadPool::limited和ThreadPool::rateLimited创建
+// 没有自己的线程，任务仍然由线程池的线程执行
+// 拿到执行名额(并发数量没有达到上限，令牌桶里有令牌)的任务按提交顺序放入线程池的任务队列，其余的在执行器自己的队列里等待
+// 正在执行的任务结束时、或者定时线程在下一个令牌产生时，再放入下一批
+class ThrottledExecutor : public std::enable_shared_from_this<ThrottledExecutor>
+{
+public:
+	~ThrottledExecutor() = default;
+
+	ThrottledExecutor(const ThrottledExecutor&) = delete;
+	ThrottledExecutor& operator=(const ThrottledExecutor&) = delete;
+
+	// 给执行器提交任务，用法和ThreadPool::submitTask一样
+	template<typename Func, typename... Args>
+	auto submitTask(Func&& func, Args&&... args) -> TaskFuture<TaskResult<Func, Args...>>
+	{
+		using RType = TaskResult<Func, Args...>;
+		std::packaged_task<RType()> task(bindTask(std::forward<Func>(func), std::forward<Args>(args)...));
+		auto completion = std::make_shared<TaskCompletion>();
+		TaskFuture<RType> result(task.get_future(), completion);
+
+		postTask(ThreadPoolBase::completionTask(std::move(task), std::move(completion)));
+		return result;
+	}
+
+	// 给执行器提交不需要返回值的任务，用法和ThreadPool::post一样
+	template<typename Func, typename... Args>
+	void post(Func&& func, Args&&... args)
+	{
+		postTask(bindTask(std::forward<Func>(func), std::forward<Args>(args)...));
+	}
+
+	// 在执行器队列里等待的任务数量
+	int pendingTaskSize() const;
+
+	// 已经放入线程池还没有执行完的任务数量
+	int runningTaskSize() const;
+
+private:
+	template<typename QueuePolicy, typename IdlePolicy, typename SizingPolicy>
+	friend class BasicThreadPool;
+
+	// maxConcurrent为0时不限制并发，tasksPerSec不大于0时不限制速率
+	ThrottledExecutor(ThreadPoolBase& pool, int maxConcurrent, double tasksPerSec, int burst);
+
+	// 任务放入执行器的队列，再尽量放入线程池
+	void postTask(Task task);
+
+	// 按顺序把拿到执行名额的任务放入线程池，直到队列空了、并发达到上限或者没有令牌
+	// 没有令牌时在线程池的定时线程上等下一个令牌
+	void dispatch();
+
+	// 线程池的线程上一个任务执行完，归还并发名额
+	void finishTask();
+
+	// 线程池停止，定时线程不再放入等待令牌的任务时调用		丢弃执行器队列里的所有任务
+	// submitTask的future得到broken_promise，whenAll/whenAny照常就绪
+	void dropTasks();
+
+	// 从令牌桶里取一个令牌，成功返回0，否则返回下一个令牌产生还需要的时间
+	// 调用者必须已经持有taskQueMtx_
+	std::chrono::nanoseconds acquireToken(std::chrono::steady_clock::time_point now);
+
+private:
+	ThreadPoolBase& pool_; // 所属的线程池
+	const int maxConcurrent_; // 并发上限，0表示不限制
+	const std::chrono::nanoseconds tokenInterval_; // 产生一个令牌的时间，0表示不限制速率
+	const std::chrono::nanoseconds burstTime_; // 令牌桶装满需要的时间(burst个令牌)
+	std::chrono::steady_clock::time_point tokenTime_; // 桶里的令牌数量 = (now - tokenTime_) / tokenInterval_，最多burst个
+	std::queue<Task> taskQue_; // 执行器自己的任务队列
+	int runningSize_; // 已经放入线程池还没有执行完的任务数量
+	bool isWaitingToken_; // 定时线程上是否已经有等令牌的dispatch
+	mutable std::mutex taskQueMtx_; // 保护上面的成员，放入线程池之前释放
+};
+
+// whenAll/whenAny使用：取future的完成通知
+// 默认构造或者从std::future转换来的TaskFuture没有完成通知，无法知道它什么时候就绪，不能当作已经完成
+template<typename T>
+std::shared_ptr<TaskCompletion> checkedCompletion(const TaskFuture<T>& future)
+{
+	if (future.completion() == nullptr)
+	{
+		throw std::invalid_argument("whenAll/whenAny: future has no completion, it did not come from ThreadPool");
+	}
+	return future.completion();
+}
+
+/*
+example:
+std::vector<TaskFuture<int>> futures;
+for (...) futures.push_back(pool.submitTask(func, i));
+auto all = whenAll(std::move(futures)).get(); // 所有任务都执行完
+*/
+// 等待所有任务执行完		返回的TaskFuture在最后一个任务完成时就绪，值是传进来的futures，已经全部就绪
+// 每个任务完成时原子计数减一，减到0的线程设置结果，调用者不需要逐个get()
+// futures必须来自线程池(submitTask、asyncRead等)，没有完成通知的future抛出std::invalid_argument
+template<typename T>
+TaskFuture<std::vector<TaskFuture<T>>> whenAll(std::vector<TaskFuture<T>> futures)
+{
+	struct State
+	{
+		std::atomic<size_t> remaining_;
+		std::vector<TaskFuture<T>> futures_;
+		std::promise<std::vector<TaskFuture<T>>> promise_;
+		std::shared_ptr<TaskCompletion> completion_;
+	};
+
+	auto state = std::make_shared<State>();
+	std::vector<std::shared_ptr<TaskCompletion>> completions;
+	for (auto& future : futures)
+	{
+		completions.push_back(checkedCompletion(future));
+	}
+	// 多计一次，注册完成之前结果不会被设置
+	state->remaining_ = futures.size() + 1;
+	state->futures_ = std::move(futures);
+	state->completion_ = std::make_shared<TaskCompletion>();
+	TaskFuture<std::vector<TaskFuture<T>>> result(state->promise_.get_future(), state->completion_);
+
+	auto finish = [state]() {
+		if (--state->remaining_ == 0)
+		{
+			state->promise_.set_value(std::move(state->futures_));
+			state->completion_->complete();
+		}
+	};
+	for (auto& completion : completions)
+	{
+		completion->onComplete(finish);
+	}
+	finish();
+	return result;
+}
+
+// 等待所有任务执行完，不同返回值类型的版本，值是tuple
+template<typename... Ts>
+TaskFuture<std::tuple<TaskFuture<Ts>...>> whenAll(TaskFuture<Ts>&&... futures)
+{
+	struct State
+	{
+		std::atomic<size_t> remaining_;
+		std::tuple<TaskFuture<Ts>...> futures_;
+		std::promise<std::tuple<TaskFuture<Ts>...>> promise_;
+		std::shared_ptr<TaskCompletion> completion_;
+	};
+
+	auto state = std::make_shared<State>();
+	std::vector<std::shared_ptr<TaskCompletion>> completions{ checkedCompletion(futures)... };
+	state->remaining_ = sizeof...(Ts) + 1;
+	state->futures_ = std::make_tuple(std::move(futures)...);
+	state->completion_ = std::make_shared<TaskCompletion>();
+	TaskFuture<std::tuple<TaskFuture<Ts>...>> result(state->promise_.get_future(), state->completion_);
+
+	auto finish = [state]() {
+		if (--state->remaining_ == 0)
+		{
+			state->promise_.set_value(std::move(state->futures_));
+			state->completion_->complete();
+		}
+	};
+	for (auto& completion : completions)
+	{
+		completion->onComplete(finish);
+	}
+	finish();
+	return result;
+}
+
+// whenAny的结果
+template<typename T>
+struct WhenAnyResult
+{
+	size_t index_; // 第一个完成的任务的下标，futures为空时等于0
+	std::vector<TaskFuture<T>> futures_; // 传进来的futures
+};
+
+/*
+example:
+std::vector<TaskFuture<Reply>> hedged;
+hedged.push_back(pool.submitTask(query, replica1));
+hedged.push_back(pool.submitTask(query, replica2));
+auto first = whenAny(std::move(hedged), true).get();
+Reply reply = first.futures_[first.index_].get();
+*/
+// 等待任意一个任务执行完		第一个任务完成时返回的TaskFuture就绪，不再等待其它任务
+// cancelOthers为true时取消其它任务：还没有开始的不再执行，正在执行的可以用ThreadPool::isCurrentTaskCancelled()检查
+// futures必须来自线程池，没有完成通知的future抛出std::invalid_argument
+template<typename T>
+TaskFuture<WhenAnyResult<T>> whenAny(std::vector<TaskFuture<T>> futures, bool cancelOthers = false)
+{
+	struct State
+	{
+		std::atomic_bool isDone_;
+		std::vector<TaskFuture<T>> futures_;
+		std::vector<std::shared_ptr<TaskCompletion>> completions_;
+		std::promise<WhenAnyResult<T>> promise_;
+		std::shared_ptr<TaskCompletion> completion_;
+	};
+
+	auto state = std::make_shared<State>();
+	for (auto& future : futures)
+	{
+		state->completions_.push_back(checkedCompletion(future));
+	}
+	state->isDone_ = false;
+	state->futures_ = std::move(futures);
+	state->completion_ = std::make_shared<TaskCompletion>();
+	TaskFuture<WhenAnyResult<T>> result(state->promise_.get_future(), state->completion_);
+
+	auto finish = [state, cancelOthers](size_t index) {
+		if (state->isDone_.exchange(true))
+		{
+			return;
+		}
+		if (cancelOthers)
+		{
+			for (size_t i = 0; i < state->completions_.size(); i++)
+			{
+				if (i != index)
+				{
+					state->completions_[i]->cancel();
+				}
+			}
+		}
+		state->promise_.set_value(WhenAnyResult<T>{ index, std::move(state->futures_) });
+		state->completion_->complete();
+	};
+
+	if (state->completions_.empty())
+	{
+		finish(0);
+		return result;
+	}
+	// 注册回调时可能已经有任务完成，回调会立即执行并移走futures_，所以遍历completions_的副本
+	std::vector<std::shared_ptr<TaskCompletion>> completions = state->completions_;
+	for (size_t i = 0; i < completions.size(); i++)
+	{
+		completions[i]->onComplete([finish, i]() { finish(i); });
+	}
+	return result;
+}
+
+// BasicThreadPool成员函数的实现
+#include "basicthreadpool.h"
+
 #endif
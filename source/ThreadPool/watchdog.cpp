@@ -0,0 +1,203 @@
+#include "watchdog.h"
+#include "threadpool.h"
+
+// 区分不同Watchdog的计数器
+static std::atomic<uint64_t> generateId(0);
+
+const int WATCHDOG_CHECKS_PER_THRESHHOLD = 4; // 每个阈值时间内检查的次数
+
+Watchdog::Watchdog(ThreadPoolBase& pool)
+	: pool_(pool), id_(++generateId), isEnabled_(false), threshold_(0), isStopped_(true)
+{
+
+}
+
+Watchdog::~Watchdog()
+{
+	stop();
+
+	// 线程的缓存里还有这个Watchdog的心跳，让线程下次注册时删除
+	std::lock_guard<std::mutex> lock(mtx_);
+	for (auto& heartbeat : heartbeats_)
+	{
+		heartbeat->isDetached_ = true;
+	}
+}
+
+Watchdog::HeartbeatCache::~HeartbeatCache()
+{
+	for (auto& pair : heartbeats_)
+	{
+		pair.second->isExited_ = true;
+	}
+}
+
+void Watchdog::start(std::chrono::milliseconds threshold, WatchdogCallback callback)
+{
+	stop();
+
+	std::lock_guard<std::mutex> lock(mtx_);
+	threshold_ = std::max(threshold, std::chrono::milliseconds(1));
+	callback_ = std::move(callback);
+	isStopped_ = false;
+	isEnabled_ = true;
+	thread_ = std::thread(&Watchdog::threadFunc, this);
+}
+
+void Watchdog::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		isEnabled_ = false;
+		isStopped_ = true;
+		stopCond_.notify_all();
+	}
+	if (thread_.joinable())
+	{
+		thread_.join();
+	}
+}
+
+Task Watchdog::wrap(Task task, const char* label)
+{
+	return [this, task = std::move(task), label]() mutable {
+		// 任务执行完恢复外层任务的心跳(任务里同步执行另一个包装过的任务时)，空闲时外层是0
+		// 任务抛出异常时同样恢复，否则看门狗一直认为它还在执行
+		struct Restore
+		{
+			~Restore()
+			{
+				heartbeat_->taskCount_.fetch_add(1, std::memory_order_release);
+				heartbeat_->startTime_.store(outerStart_, std::memory_order_relaxed);
+				heartbeat_->label_.store(outerLabel_, std::memory_order_relaxed);
+			}
+
+			Heartbeat* heartbeat_;
+			int64_t outerStart_;
+			const char* outerLabel_;
+		};
+
+		Heartbeat* heartbeat = currentHeartbeat();
+		Restore restore{ heartbeat, heartbeat->startTime_.load(std::memory_order_relaxed), heartbeat->label_.load(std::memory_order_relaxed) };
+		heartbeat->label_.store(label, std::memory_order_relaxed);
+		heartbeat->startTime_.store(now(), std::memory_order_release);
+		task();
+	};
+}
+
+Watchdog::Heartbeat* Watchdog::currentHeartbeat()
+{
+	static thread_local HeartbeatCache cache;
+	auto it = cache.heartbeats_.find(id_);
+	if (it != cache.heartbeats_.end())
+	{
+		return it->second.get();
+	}
+
+	// 顺便删除已经析构的Watchdog的心跳
+	for (auto iter = cache.heartbeats_.begin(); iter != cache.heartbeats_.end();)
+	{
+		iter = iter->second->isDetached_ ? cache.heartbeats_.erase(iter) : std::next(iter);
+	}
+
+	auto heartbeat = std::make_shared<Heartbeat>();
+	heartbeat->workerId_ = ThreadPoolBase::currentWorkerIndex();
+	cache.heartbeats_.emplace(id_, heartbeat);
+
+	std::lock_guard<std::mutex> lock(mtx_);
+	pruneHeartbeats();
+	heartbeats_.push_back(heartbeat);
+	return heartbeat.get();
+}
+
+size_t Watchdog::heartbeatSize()
+{
+	std::lock_guard<std::mutex> lock(mtx_);
+	pruneHeartbeats();
+	return heartbeats_.size();
+}
+
+// 删除线程已经退出的心跳
+void Watchdog::pruneHeartbeats()
+{
+	heartbeats_.erase(std::remove_if(heartbeats_.begin(), heartbeats_.end(),
+		[](const std::shared_ptr<Heartbeat>& heartbeat) { return heartbeat->isExited_.load(); }), heartbeats_.end());
+}
+
+int64_t Watchdog::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// 看门狗线程函数
+void Watchdog::threadFunc()
+{
+	// 一次发现的问题，不持有锁调用回调
+	struct Report
+	{
+		int workerId_;
+		const char* label_;
+		std::chrono::milliseconds elapsed_;
+	};
+
+	uint64_t lastCompleted = pool_.completedTaskSize();
+	int64_t lastProgressTime = now();
+	bool isQueueReported = false;
+
+	std::unique_lock<std::mutex> lock(mtx_);
+	int64_t threshold = std::chrono::duration_cast<std::chrono::nanoseconds>(threshold_).count();
+	WatchdogCallback callback = callback_;
+	for (;;)
+	{
+		if (stopCond_.wait_for(lock, threshold_ / WATCHDOG_CHECKS_PER_THRESHHOLD, [&]()->bool { return isStopped_; }))
+		{
+			return;
+		}
+
+		std::vector<Report> reports;
+		int64_t nowTime = now();
+		pruneHeartbeats();
+
+		// 1.执行时间超过阈值的任务
+		for (auto& heartbeat : heartbeats_)
+		{
+			// 前后两次读取的任务数量相同，开始时间和名称才属于同一个任务
+			uint64_t count = heartbeat->taskCount_.load(std::memory_order_acquire);
+			int64_t startTime = heartbeat->startTime_.load(std::memory_order_acquire);
+			const char* label = heartbeat->label_.load(std::memory_order_relaxed);
+			if (startTime == 0 || count != heartbeat->taskCount_.load(std::memory_order_acquire))
+			{
+				continue;
+			}
+			if (nowTime - startTime >= threshold && heartbeat->reportedCount_ != count)
+			{
+				heartbeat->reportedCount_ = count;
+				reports.push_back({ heartbeat->workerId_, label,
+					std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::nanoseconds(nowTime - startTime)) });
+			}
+		}
+
+		// 2.有排队的任务但是没有任务执行完
+		lock.unlock();
+		uint64_t completed = pool_.completedTaskSize();
+		bool hasPending = pool_.pendingTaskSize() > 0;
+		if (completed != lastCompleted || !hasPending)
+		{
+			lastCompleted = completed;
+			lastProgressTime = nowTime;
+			isQueueReported = false;
+		}
+		else if (nowTime - lastProgressTime >= threshold && !isQueueReported)
+		{
+			isQueueReported = true;
+			reports.push_back({ -1, "queue",
+				std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::nanoseconds(nowTime - lastProgressTime)) });
+		}
+
+		for (const Report& report : reports)
+		{
+			callback(report.workerId_, report.label_, report.elapsed_);
+		}
+		lock.lock();
+	}
+}
@@ -0,0 +1,103 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class Task;
+class ThreadPoolBase;
+
+// 看门狗的回调：线程编号(队列没有进展时为-1)，任务名称(没有时为nullptr)，已经经过的时间
+using WatchdogCallback = std::function<void(int workerId, const char* label, std::chrono::milliseconds elapsed)>;
+
+/*
+Watchdog 线程池的看门狗
+每个执行任务的线程一个心跳：任务开始时记录开始时间和任务名称，结束时清除，只是几次原子写
+看门狗线程定期检查：
+1.任务执行时间超过阈值(死锁、死循环、没有超时的阻塞调用)，每个任务报告一次
+2.有排队的任务，但是超过阈值的时间内没有任何任务执行完(线程全部卡住、线程池饥饿)，每次停滞报告一次
+回调在看门狗线程上调用，不持有线程池的锁
+*/
+class Watchdog
+{
+public:
+	Watchdog(ThreadPoolBase& pool);
+	~Watchdog();
+
+	Watchdog(const Watchdog&) = delete;
+	Watchdog& operator=(const Watchdog&) = delete;
+
+	// 启动看门狗线程，已经启动时先停止再用新的参数启动
+	void start(std::chrono::milliseconds threshold, WatchdogCallback callback);
+
+	// 停止看门狗线程，已经包装的任务照常记录心跳
+	void stop();
+
+	bool isEnabled() const
+	{
+		return isEnabled_;
+	}
+
+	// 包装任务：执行时更新当前线程的心跳
+	Task wrap(Task task, const char* label);
+
+	// 注册的心跳数量，每个执行过包装的任务、还没有退出的线程一个
+	size_t heartbeatSize();
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	// 一个线程的心跳		执行任务的线程写，看门狗线程读
+	struct Heartbeat
+	{
+		int workerId_; // 注册时的线程编号
+		std::atomic<int64_t> startTime_{ 0 }; // 正在执行的任务的开始时间(纳秒)，0表示空闲
+		std::atomic<const char*> label_{ nullptr }; // 正在执行的任务的名称
+		std::atomic<uint64_t> taskCount_{ 0 }; // 执行完的任务数量，区分前后两个任务
+		uint64_t reportedCount_ = UINT64_MAX; // 已经报告过的任务，只有看门狗线程访问
+		std::atomic_bool isExited_{ false }; // 线程已经退出，Watchdog删除这个心跳
+		std::atomic_bool isDetached_{ false }; // Watchdog已经析构，线程删除这个心跳
+	};
+
+	// 线程局部的心跳缓存		一个线程可能执行多个线程池的任务(共享线程)，每个Watchdog一个心跳
+	// 线程退出时析构，标记它的心跳已经退出
+	struct HeartbeatCache
+	{
+		~HeartbeatCache();
+
+		std::unordered_map<uint64_t, std::shared_ptr<Heartbeat>> heartbeats_; // Watchdog的id => 心跳
+	};
+
+	// 当前线程在这个Watchdog上的心跳，第一次调用时注册
+	Heartbeat* currentHeartbeat();
+
+	// 删除线程已经退出的心跳		调用者已经持有mtx_
+	void pruneHeartbeats();
+
+	static int64_t now();
+
+	// 看门狗线程函数
+	void threadFunc();
+
+private:
+	ThreadPoolBase& pool_;
+	const uint64_t id_; // 区分不同的Watchdog，线程局部的心跳缓存用
+	std::atomic_bool isEnabled_;
+	std::chrono::milliseconds threshold_; // 阈值
+	WatchdogCallback callback_;
+	std::thread thread_; // 看门狗线程
+	bool isStopped_; // 通知看门狗线程退出
+	std::condition_variable stopCond_;
+	std::vector<std::shared_ptr<Heartbeat>> heartbeats_; // 所有线程的心跳，线程退出后删除
+	std::mutex mtx_; // 保护上面的成员
+};
+
+#endif
@@ -0,0 +1,356 @@
+// bench.cpp : 线程池的开环压测工具，测量排队延迟和端到端延迟的尾部分布
+//
+// 多个生产者线程按固定的到达速率(恒定间隔或者泊松到达)调用submitTask，不等待任务完成
+// 延迟从任务"应该"提交的时间开始计算，而不是实际提交的时间：
+// submitTask被队列上限阻塞时，后面的任务晚提交的那段时间也计入延迟，修正coordinated omission
+// 从低负载一直扫描到超过饱和，fixed和cached模式分别测试
+//
+// 用法: bench [--mode fixed|cached|both] [--threads N] [--producers N]
+//             [--arrival constant|poisson] [--cost const|exp|bimodal] [--cost-us N]
+//             [--queue N] [--max-threads N] [--seconds N]
+// 有自己的main，和ThreadPool/test.cpp分开编译：
+// g++ -std=c++17 -O2 -pthread -I../ThreadPool bench.cpp ../ThreadPool/threadpool.cpp ../ThreadPool/profiler.cpp ...(除test.cpp以外的cpp)
+
+#include "threadpool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// 对数-线性分桶的延迟直方图(HdrHistogram的做法)
+// 每个2的幂区间分成SUB_BUCKET_COUNT个桶，相对误差不超过1/SUB_BUCKET_COUNT
+// 桶是原子计数，多个线程可以同时记录
+class LatencyHistogram
+{
+public:
+	LatencyHistogram() : counts_(BUCKET_COUNT), totalCount_(0), maxValue_(0)
+	{
+	}
+
+	// 记录一个值，单位ns
+	void record(int64_t value)
+	{
+		if (value < 0)
+		{
+			value = 0;
+		}
+		counts_[indexOf(value)].fetch_add(1, std::memory_order_relaxed);
+		totalCount_.fetch_add(1, std::memory_order_relaxed);
+
+		int64_t curMax = maxValue_.load(std::memory_order_relaxed);
+		while (value > curMax && !maxValue_.compare_exchange_weak(curMax, value, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	// 百分位数，q在0~1之间，返回对应桶的上界
+	int64_t percentile(double q) const
+	{
+		uint64_t total = totalCount_.load();
+		if (total == 0)
+		{
+			return 0;
+		}
+		uint64_t target = (uint64_t)std::ceil(q * total);
+		if (target == 0)
+		{
+			target = 1;
+		}
+		uint64_t seen = 0;
+		for (int i = 0; i < BUCKET_COUNT; i++)
+		{
+			seen += counts_[i].load(std::memory_order_relaxed);
+			if (seen >= target)
+			{
+				return std::min(upperBoundOf(i), maxValue_.load());
+			}
+		}
+		return maxValue_.load();
+	}
+
+	int64_t max() const
+	{
+		return maxValue_.load();
+	}
+
+	uint64_t count() const
+	{
+		return totalCount_.load();
+	}
+
+private:
+	static const int SUB_BUCKET_BITS = 7;
+	static const int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+	static const int MAGNITUDE_COUNT = 64 - SUB_BUCKET_BITS;
+	static const int BUCKET_COUNT = (MAGNITUDE_COUNT + 1) * SUB_BUCKET_COUNT;
+
+	// 小于SUB_BUCKET_COUNT的值每个值一个桶，更大的值按最高位所在的区间分桶
+	static int indexOf(int64_t value)
+	{
+		uint64_t v = (uint64_t)value;
+		if (v < (uint64_t)SUB_BUCKET_COUNT)
+		{
+			return (int)v;
+		}
+		int magnitude = 63 - __builtin_clzll(v) - SUB_BUCKET_BITS + 1; // 需要右移的位数
+		int sub = (int)(v >> magnitude) - SUB_BUCKET_COUNT / 2;
+		return SUB_BUCKET_COUNT + (magnitude - 1) * (SUB_BUCKET_COUNT / 2) + sub;
+	}
+
+	static int64_t upperBoundOf(int index)
+	{
+		if (index < SUB_BUCKET_COUNT)
+		{
+			return index;
+		}
+		int magnitude = (index - SUB_BUCKET_COUNT) / (SUB_BUCKET_COUNT / 2) + 1;
+		int sub = (index - SUB_BUCKET_COUNT) % (SUB_BUCKET_COUNT / 2) + SUB_BUCKET_COUNT / 2;
+		return ((int64_t)(sub + 1) << magnitude) - 1;
+	}
+
+private:
+	std::vector<std::atomic<uint64_t>> counts_;
+	std::atomic<uint64_t> totalCount_;
+	std::atomic<int64_t> maxValue_;
+};
+
+// 压测参数
+struct BenchConfig
+{
+	std::string mode_ = "both";
+	int threads_ = (int)std::thread::hardware_concurrency();
+	int producers_ = 2;
+	std::string arrival_ = "poisson";
+	std::string cost_ = "exp";
+	double costUs_ = 50; // 任务平均耗时
+	int queue_ = 1024; // setTaskQueMaxThreshHold
+	int maxThreads_ = 1024; // setThreadSizeMaxThreshHold
+	double seconds_ = 2; // 每个负载点的压测时间
+};
+
+// 一个负载点的结果
+struct BenchResult
+{
+	LatencyHistogram queueWait_; // 应该提交的时间 => 开始执行
+	LatencyHistogram endToEnd_; // 应该提交的时间 => 执行结束
+	std::atomic<uint64_t> completed_{ 0 };
+	std::atomic<uint64_t> dropped_{ 0 }; // 任务队列满了1s，提交失败被丢弃的任务
+	uint64_t submitted_ = 0;
+};
+
+// 跟着任务一起移动，任务没有执行就析构说明提交失败被丢弃了
+// 丢弃的任务记录应该提交的时间到被拒绝的时间，也放进两个直方图
+// 否则饱和时最差的那些请求不出现在p99/p99.9里，又回到了coordinated omission
+class DropRecorder
+{
+public:
+	DropRecorder(BenchResult& result, Clock::time_point intended)
+		: result_(&result), intended_(intended), isPending_(true)
+	{
+	}
+
+	DropRecorder(DropRecorder&& other) noexcept
+		: result_(other.result_), intended_(other.intended_), isPending_(other.isPending_)
+	{
+		other.isPending_ = false;
+	}
+
+	DropRecorder(const DropRecorder&) = delete;
+	DropRecorder& operator=(const DropRecorder&) = delete;
+
+	~DropRecorder()
+	{
+		if (isPending_)
+		{
+			int64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - intended_).count();
+			result_->queueWait_.record(latency);
+			result_->endToEnd_.record(latency);
+			result_->dropped_.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	// 任务开始执行
+	void disarm()
+	{
+		isPending_ = false;
+	}
+
+private:
+	BenchResult* result_;
+	Clock::time_point intended_;
+	bool isPending_;
+};
+
+// 忙等一段时间，模拟CPU密集的任务
+static void spinFor(int64_t nanos)
+{
+	auto end = Clock::now() + std::chrono::nanoseconds(nanos);
+	while (Clock::now() < end)
+	{
+	}
+}
+
+// 按配置的分布生成任务耗时，单位ns
+static int64_t sampleCost(const BenchConfig& config, std::mt19937_64& rng)
+{
+	double mean = config.costUs_ * 1000;
+	if (config.cost_ == "const")
+	{
+		return (int64_t)mean;
+	}
+	if (config.cost_ == "bimodal")
+	{
+		// 95%的任务是0.5倍，5%的任务是10.5倍，平均值不变
+		std::uniform_real_distribution<double> dist(0, 1);
+		return (int64_t)(dist(rng) < 0.95 ? mean * 0.5 : mean * 10.5);
+	}
+	std::exponential_distribution<double> dist(1.0 / mean);
+	return (int64_t)dist(rng);
+}
+
+// 以offeredRate(任务/秒)的速率压测一次
+static void runOnce(const BenchConfig& config, ThreadPoolMode mode, double offeredRate, BenchResult& result)
+{
+	ThreadPool pool;
+	pool.setMode(mode);
+	pool.setTaskQueMaxThreshHold(config.queue_);
+	pool.setThreadSizeMaxThreshHold(config.maxThreads_);
+	pool.start(config.threads_);
+
+	auto begin = Clock::now() + std::chrono::milliseconds(10);
+	auto end = begin + std::chrono::nanoseconds((int64_t)(config.seconds_ * 1e9));
+	double interval = config.producers_ * 1e9 / offeredRate; // 每个生产者的平均提交间隔，单位ns
+
+	std::vector<std::thread> producers;
+	std::vector<uint64_t> submitted(config.producers_, 0);
+	for (int p = 0; p < config.producers_; p++)
+	{
+		producers.emplace_back([&, p]() {
+			std::mt19937_64 rng(12345 + p);
+			std::exponential_distribution<double> gap(1.0 / interval);
+			// 各个生产者错开起始时间
+			auto intended = begin + std::chrono::nanoseconds((int64_t)(interval * p / config.producers_));
+			while (intended < end)
+			{
+				std::this_thread::sleep_until(intended);
+
+				int64_t cost = sampleCost(config, rng);
+				// 开环压测不等待结果，返回的future直接丢弃
+				pool.submitTask([&result, intended, cost, recorder = DropRecorder(result, intended)]() mutable {
+					recorder.disarm();
+					auto start = Clock::now();
+					spinFor(cost);
+					auto finish = Clock::now();
+					result.queueWait_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(start - intended).count());
+					result.endToEnd_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(finish - intended).count());
+					result.completed_.fetch_add(1, std::memory_order_relaxed);
+				});
+				submitted[p]++;
+
+				// 下一个任务应该提交的时间只由到达过程决定，和这次提交花了多久无关
+				double next = config.arrival_ == "constant" ? interval : gap(rng);
+				intended += std::chrono::nanoseconds((int64_t)next);
+			}
+		});
+	}
+	for (auto& t : producers)
+	{
+		t.join();
+	}
+	for (uint64_t n : submitted)
+	{
+		result.submitted_ += n;
+	}
+	// pool析构时等待所有任务执行完
+}
+
+static void printHeader()
+{
+	std::printf("%-7s %10s %10s %8s | %-36s | %-36s\n", "mode", "offered/s", "done/s", "dropped",
+		"queue wait us  p50 / p99 / p99.9 / max", "end to end us  p50 / p99 / p99.9 / max");
+	std::printf("(dropped tasks are included in both histograms with their intended -> rejection latency)\n");
+}
+
+static void printRow(const char* mode, double offered, double seconds, const BenchResult& r)
+{
+	auto us = [](int64_t ns) { return ns / 1000.0; };
+	std::printf("%-7s %10.0f %10.0f %8llu | %8.1f %8.1f %9.1f %9.1f | %8.1f %8.1f %9.1f %9.1f\n",
+		mode, offered, r.completed_ / seconds, (unsigned long long)r.dropped_.load(),
+		us(r.queueWait_.percentile(0.5)), us(r.queueWait_.percentile(0.99)),
+		us(r.queueWait_.percentile(0.999)), us(r.queueWait_.max()),
+		us(r.endToEnd_.percentile(0.5)), us(r.endToEnd_.percentile(0.99)),
+		us(r.endToEnd_.percentile(0.999)), us(r.endToEnd_.max()));
+	std::fflush(stdout);
+}
+
+static bool parseArgs(int argc, char** argv, BenchConfig& config)
+{
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string key = argv[i];
+		const char* value = argv[i + 1];
+		if (key == "--mode") config.mode_ = value;
+		else if (key == "--threads") config.threads_ = std::atoi(value);
+		else if (key == "--producers") config.producers_ = std::atoi(value);
+		else if (key == "--arrival") config.arrival_ = value;
+		else if (key == "--cost") config.cost_ = value;
+		else if (key == "--cost-us") config.costUs_ = std::atof(value);
+		else if (key == "--queue") config.queue_ = std::atoi(value);
+		else if (key == "--max-threads") config.maxThreads_ = std::atoi(value);
+		else if (key == "--seconds") config.seconds_ = std::atof(value);
+		else
+		{
+			std::fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return false;
+		}
+	}
+	return argc % 2 == 1 && config.threads_ > 0 && config.producers_ > 0 && config.costUs_ > 0;
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	if (!parseArgs(argc, argv, config))
+	{
+		std::fprintf(stderr, "usage: bench [--mode fixed|cached|both] [--threads N] [--producers N]\n"
+			"             [--arrival constant|poisson] [--cost const|exp|bimodal] [--cost-us N]\n"
+			"             [--queue N] [--max-threads N] [--seconds N]\n");
+		return 1;
+	}
+
+	// fixed模式的理论吞吐上限
+	double capacity = config.threads_ * 1e6 / config.costUs_;
+	const double loads[] = { 0.1, 0.3, 0.5, 0.7, 0.8, 0.9, 0.95, 1.0, 1.1, 1.25 };
+
+	std::printf("threads=%d producers=%d arrival=%s cost=%s/%.1fus queue=%d capacity=%.0f/s\n",
+		config.threads_, config.producers_, config.arrival_.c_str(), config.cost_.c_str(),
+		config.costUs_, config.queue_, capacity);
+	printHeader();
+
+	for (int m = 0; m < 2; m++)
+	{
+		ThreadPoolMode mode = m == 0 ? ThreadPoolMode::MODE_FIXED : ThreadPoolMode::MODE_CACHED;
+		const char* name = m == 0 ? "fixed" : "cached";
+		if (config.mode_ != "both" && config.mode_ != name)
+		{
+			continue;
+		}
+
+		for (double load : loads)
+		{
+			BenchResult result;
+			runOnce(config, mode, capacity * load, result);
+			printRow(name, capacity * load, config.seconds_, result);
+		}
+	}
+	return 0;
+}